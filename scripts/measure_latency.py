@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+"""Measures the latency from an OgMap to the path planned on it.
+
+A goal is requested as soon as each new map arrives, and the path sent for
+it is matched to that map by its stamp (the planner stamps each path with
+the OgMap it was planned on). The latency is the time from the map's stamp
+to the path arriving, so it covers the image provider, the cspace stage and
+planning. Run it against launch/latency.launch with and without nodelets
+to compare the two.
+
+Private parameters:
+  ~map      The occupancy grid topic the OgMaps are made from (default /local_map/local_map)
+  ~goals    The goals requested in turn, as a list of [x, y] (default [[2.0, 2.0], [-2.0, -2.0]])
+  ~samples  The number of paths to measure (default 100)
+  ~timeout  How long (s) to wait for each map and path (default 10.0)
+  ~output   A csv file each latency (ms) is written to, empty if none (default '')
+"""
+import threading
+
+import rospy
+from geometry_msgs.msg import PoseArray
+from nav_msgs.msg import OccupancyGrid
+from prm_sim.srv import RequestGoal
+
+
+class LatencyMeter(object):
+    def __init__(self):
+        self.map_topic = rospy.get_param('~map', '/local_map/local_map')
+        self.goals = rospy.get_param('~goals', [[2.0, 2.0], [-2.0, -2.0]])
+        self.samples = rospy.get_param('~samples', 100)
+        self.timeout = rospy.get_param('~timeout', 10.0)
+        self.output = rospy.get_param('~output', '')
+
+        self.lock = threading.Condition()
+        self.map_stamp = None
+        self.paths = []
+
+        rospy.Subscriber(self.map_topic, OccupancyGrid, self.map_callback, queue_size=1)
+        rospy.Subscriber('path', PoseArray, self.path_callback, queue_size=10)
+
+        rospy.wait_for_service('request_goal')
+        self.request_goal = rospy.ServiceProxy('request_goal', RequestGoal)
+
+    def map_callback(self, msg):
+        with self.lock:
+            self.map_stamp = msg.header.stamp
+            self.lock.notify_all()
+
+    def path_callback(self, msg):
+        arrived = rospy.Time.now()
+        with self.lock:
+            self.paths.append((msg.header.stamp, arrived))
+            self.lock.notify_all()
+
+    def wait_for(self, ready):
+        deadline = rospy.Time.now() + rospy.Duration(self.timeout)
+        with self.lock:
+            while not ready() and not rospy.is_shutdown() and rospy.Time.now() < deadline:
+                self.lock.wait(0.05)
+            return ready()
+
+    def measure(self, goal):
+        """Requests a goal on the next map, returning the latency (s) or None."""
+        with self.lock:
+            last = self.map_stamp
+        if not self.wait_for(lambda: self.map_stamp is not None and self.map_stamp != last):
+            rospy.logwarn('No new map on %s', self.map_topic)
+            return None
+
+        with self.lock:
+            stamp = self.map_stamp
+            del self.paths[:]
+        self.request_goal(goal[0], goal[1])
+
+        #Paths planned on an earlier map (the planner hadn't taken this one yet) are skipped
+        if not self.wait_for(lambda: any(p[0] >= stamp for p in self.paths)):
+            rospy.logwarn('No path planned on the map of %.3f', stamp.to_sec())
+            return None
+
+        with self.lock:
+            path = next(p for p in self.paths if p[0] >= stamp)
+        return (path[1] - path[0]).to_sec()
+
+    def run(self):
+        latencies = []
+        i = 0
+        while len(latencies) < self.samples and not rospy.is_shutdown():
+            latency = self.measure(self.goals[i % len(self.goals)])
+            i += 1
+            if latency is not None:
+                latencies.append(latency * 1000.0)
+                rospy.loginfo('Map to path: %.1f ms (%d/%d)', latencies[-1], len(latencies), self.samples)
+
+        if not latencies:
+            rospy.logerr('No latencies measured')
+            return
+
+        latencies.sort()
+        count = len(latencies)
+        rospy.loginfo('Map to path latency over %d paths: mean %.1f ms, median %.1f ms, '
+                      '95th percentile %.1f ms, max %.1f ms',
+                      count, sum(latencies) / count, latencies[count // 2],
+                      latencies[min(count - 1, int(count * 0.95))], latencies[-1])
+
+        if self.output:
+            with open(self.output, 'w') as f:
+                f.write('latency_ms\n')
+                for latency in latencies:
+                    f.write('%f\n' % latency)
+
+
+if __name__ == '__main__':
+    rospy.init_node('measure_latency')
+    LatencyMeter().run()
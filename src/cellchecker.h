@@ -0,0 +1,351 @@
+/*! @file
+ *
+ *  @brief Compile-time specialised collision checking within a cspace.
+ *
+ *  The type of each cell in the configuration space, and what makes a
+ *  cell 'free', are supplied as a policy to CellChecker. This allows the
+ *  inner loop of a line check to be generated for a specific cell layout,
+ *  rather than relying on the runtime type of the cv::Mat. The binary
+ *  greyscale cspace used by LocalMap is TGreyCells.
+ *
+ *  @author agent
+ *  @date 17-10-2026
+*/
+#ifndef CELLCHECKER_H
+#define CELLCHECKER_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdlib>
+
+const float CELL_COST_LETHAL = 1.0f; /*!< Cells in a cost map with this cost or more are not traversable */
+
+struct TFreeIfWhite /*!< A greyscale cell is free if it is white */
+{
+  bool operator()(uchar cell) const { return cell == 255; }
+};
+
+struct TFreeIfBelowLethal /*!< A cost cell is free if its cost is below CELL_COST_LETHAL */
+{
+  bool operator()(float cell) const { return cell >= 0.0f && cell < CELL_COST_LETHAL; }
+};
+
+template <typename T, typename FreePredicate>
+struct TDenseCells /*!< One cell of type T per pixel, free according to FreePredicate */
+{
+  typedef T cell;
+
+  static int width(const cv::Mat &cspace) { return cspace.cols; }
+  static int height(const cv::Mat &cspace) { return cspace.rows; }
+
+  static bool isFree(const cv::Mat &cspace, int x, int y){
+    return FreePredicate()(cspace.ptr<T>(y)[x]);
+  }
+
+  static bool isFree(const T *cells, ptrdiff_t offset){
+    return FreePredicate()(cells[offset]);
+  }
+};
+
+struct TPackedBitCells /*!< One bit per pixel (most significant bit first), a set bit is free */
+{
+  typedef uchar cell;
+
+  static int width(const cv::Mat &cspace) { return cspace.cols * 8; }
+  static int height(const cv::Mat &cspace) { return cspace.rows; }
+
+  static bool isFree(const cv::Mat &cspace, int x, int y){
+    return (cspace.ptr<uchar>(y)[x >> 3] & (0x80 >> (x & 7))) != 0;
+  }
+
+  /*! @brief Packs a greyscale cspace into one bit per pixel.
+   *
+   *  @param grey The greyscale cspace, where white pixels are free.
+   *  @return Mat - The packed cspace, with (grey.cols + 7) / 8 columns.
+   */
+  static cv::Mat pack(const cv::Mat &grey){
+    cv::Mat packed(grey.rows, (grey.cols + 7) / 8, CV_8UC1, cv::Scalar(0));
+
+    for(int y = 0; y < grey.rows; y++){
+      const uchar *src = grey.ptr<uchar>(y);
+      uchar *dst = packed.ptr<uchar>(y);
+
+      for(int x = 0; x < grey.cols; x++){
+        if(src[x] == 255){
+          dst[x >> 3] |= (0x80 >> (x & 7));
+        }
+      }
+    }
+
+    return packed;
+  }
+};
+
+typedef TDenseCells<uchar, TFreeIfWhite> TGreyCells;        /*!< An 8-bit greyscale cspace (CV_8UC1) */
+typedef TDenseCells<float, TFreeIfBelowLethal> TCostCells;  /*!< A traversal cost cspace (CV_32FC1) */
+
+/*! @brief Visits each cell on the 8-connected line between two points.
+ *
+ *  The line is walked from start to end (inclusive) using Bresenham's
+ *  algorithm. No bounds checking is done, both points must be within
+ *  the cspace.
+ *
+ *  @param start The starting position.
+ *  @param end The ending position.
+ *  @param visit Called with the (x, y) of each cell, returns FALSE to stop the walk.
+ *  @return bool - TRUE if every cell on the line was visited.
+ */
+template <typename Visitor>
+bool walkLine(cv::Point start, cv::Point end, Visitor visit){
+  int dx = std::abs(end.x - start.x), sx = start.x < end.x ? 1 : -1;
+  int dy = -std::abs(end.y - start.y), sy = start.y < end.y ? 1 : -1;
+  int error = dx + dy;
+  int x = start.x, y = start.y;
+
+  while(true){
+    if(!visit(x, y)){
+      return false;
+    }
+
+    if(x == end.x && y == end.y){
+      return true;
+    }
+
+    int e2 = 2 * error;
+    if(e2 >= dy){
+      error += dy;
+      x += sx;
+    }
+
+    if(e2 <= dx){
+      error += dx;
+      y += sy;
+    }
+  }
+}
+
+/*! @brief Visits the offsets of each cell on the line between two points, in two buffers.
+ *
+ *  As walkOffsets(start, end, stride, visit), but the same cells are also walked in a second buffer of
+ *  the same size with a different row stride (e.g. a cost map alongside the
+ *  cspace), so both are stepped with integer adds.
+ *
+ *  @param start The starting position.
+ *  @param end The ending position.
+ *  @param stride The number of cells between the start of each row of the first buffer.
+ *  @param otherStride The number of cells between the start of each row of the second buffer.
+ *  @param visit Called with the offset of each cell in both buffers, returns FALSE to stop the walk.
+ *  @return bool - TRUE if every cell on the line was visited.
+ */
+template <typename Visitor>
+bool walkOffsets(cv::Point start, cv::Point end, ptrdiff_t stride, ptrdiff_t otherStride, Visitor visit){
+  int dx = end.x - start.x;
+  int dy = end.y - start.y;
+
+  unsigned int absDx = std::abs(dx);
+  unsigned int absDy = std::abs(dy);
+
+  ptrdiff_t offsetDx = dx > 0 ? 1 : -1;
+  ptrdiff_t offsetDy = (dy > 0 ? 1 : -1) * stride;
+  ptrdiff_t otherDy = (dy > 0 ? 1 : -1) * otherStride;
+
+  //Step along the dominant axis (a) every cell, and the other (b) as the error accumulates
+  bool xDominant = absDx >= absDy;
+  unsigned int absDa = xDominant ? absDx : absDy;
+  unsigned int absDb = xDominant ? absDy : absDx;
+  ptrdiff_t offsetA = xDominant ? offsetDx : offsetDy;
+  ptrdiff_t offsetB = xDominant ? offsetDy : offsetDx;
+  ptrdiff_t otherA = xDominant ? offsetDx : otherDy;
+  ptrdiff_t otherB = xDominant ? otherDy : offsetDx;
+
+  ptrdiff_t offset = start.y * stride + start.x;
+  ptrdiff_t other = start.y * otherStride + start.x;
+  unsigned int error = absDa / 2;
+
+  for(unsigned int i = 0; i <= absDa; ++i){
+    if(!visit(offset, other)){
+      return false;
+    }
+
+    offset += offsetA;
+    other += otherA;
+    error += absDb;
+    if(error >= absDa){
+      offset += offsetB;
+      other += otherB;
+      error -= absDa;
+    }
+  }
+
+  return true;
+}
+
+/*! @brief Visits the offset of each cell on the 8-connected line between two points.
+ *
+ *  Adapted from HectorMapTools::DistanceMeasurementProvider::bresenham2D, the
+ *  line is walked along its dominant axis as offsets into a contiguous buffer,
+ *  so each step is one or two integer adds. The line includes both points.
+ *  No bounds checking is done, both points must be within the buffer.
+ *
+ *  @param start The starting position.
+ *  @param end The ending position.
+ *  @param stride The number of cells between the start of each row.
+ *  @param visit Called with the offset of each cell from the first cell, returns FALSE to stop the walk.
+ *  @return bool - TRUE if every cell on the line was visited.
+ */
+template <typename Visitor>
+bool walkOffsets(cv::Point start, cv::Point end, ptrdiff_t stride, Visitor visit){
+  return walkOffsets(start, end, stride, 0, [&visit](ptrdiff_t offset, ptrdiff_t){ return visit(offset); });
+}
+
+template <typename Cells>
+class CellChecker
+{
+public:
+  /*! @brief Checks if a point is within the cspace and free.
+   *
+   *  @param cspace The configuration space, laid out as described by Cells.
+   *  @param p The point to check.
+   *  @return bool - TRUE if the point is accessible.
+   */
+  static bool isAccessible(const cv::Mat &cspace, cv::Point p){
+    return inBounds(cspace, p) && Cells::isFree(cspace, p.x, p.y);
+  }
+
+  /*! @brief Determines if every cell on the line between two points is free.
+   *
+   *  This walks the 8-connected line between start and end (inclusive).
+   *
+   *  @param cspace The configuration space, laid out as described by Cells.
+   *  @param start The starting position.
+   *  @param end The ending position.
+   *  @return bool - TRUE if there is nothing blocking the path between
+   *                 start and end.
+   */
+  static bool canConnect(const cv::Mat &cspace, cv::Point start, cv::Point end){
+    //The cspace is rectangular, so if both ends are inside so is the whole line
+    if(!inBounds(cspace, start) || !inBounds(cspace, end)){
+      return false;
+    }
+
+    return walkLine(start, end, [&cspace](int x, int y){ return Cells::isFree(cspace, x, y); });
+  }
+
+  /*! @brief Determines if every cell on the line between two points is free, walking raw offsets.
+   *
+   *  Equivalent to canConnect(), but the cspace is walked as a contiguous
+   *  buffer with walkOffsets(), avoiding a row lookup per cell. Only
+   *  layouts with one cell per pixel (e.g. TDenseCells) are supported.
+   *
+   *  @param cspace The configuration space, laid out as described by Cells.
+   *  @param start The starting position.
+   *  @param end The ending position.
+   *  @return bool - TRUE if there is nothing blocking the path between
+   *                 start and end.
+   *
+   *  @note The cells visited may differ from canConnect() by one pixel where
+   *        the line passes exactly between two, as the error is rounded differently.
+   */
+  static bool canConnectOffsets(const cv::Mat &cspace, cv::Point start, cv::Point end){
+    typedef typename Cells::cell cell;
+
+    if(!inBounds(cspace, start) || !inBounds(cspace, end)){
+      return false;
+    }
+
+    const cell *cells = cspace.ptr<cell>(0);
+    ptrdiff_t stride = cspace.step / sizeof(cell);
+
+    return walkOffsets(start, end, stride, [cells](ptrdiff_t offset){ return Cells::isFree(cells, offset); });
+  }
+
+  /*! @brief Determines if two points can be connected, and the cost of doing so.
+   *
+   *  The cost of each cell is accumulated in the same walk as checking the
+   *  cells are free, so costing an edge doesn't need a second traversal.
+   *
+   *  @param cspace The configuration space, laid out as described by Cells.
+   *  @param costs The traversal cost of each cell (CV_32FC1, same size as cspace).
+   *  @param start The starting position.
+   *  @param end The ending position.
+   *  @param meanCost Set to the mean cost of the cells on the line, if connected.
+   *  @return bool - TRUE if there is nothing blocking the path between
+   *                 start and end.
+   */
+  static bool canConnect(const cv::Mat &cspace, const cv::Mat &costs,
+                         cv::Point start, cv::Point end, double &meanCost){
+    if(!inBounds(cspace, start) || !inBounds(cspace, end)){
+      return false;
+    }
+
+    double total = 0;
+    unsigned int cells = 0;
+    bool connected = walkLine(start, end, [&](int x, int y){
+      if(!Cells::isFree(cspace, x, y)){
+        return false;
+      }
+
+      total += costs.ptr<float>(y)[x];
+      cells++;
+      return true;
+    });
+
+    if(connected){
+      meanCost = total / cells;
+    }
+
+    return connected;
+  }
+
+  /*! @brief Determines if two points can be connected, and the cost of doing so, walking raw offsets.
+   *
+   *  Equivalent to the cost overload of canConnect(), but both the cspace and
+   *  the costs are walked with walkOffsets(), so the cells visited (and so the
+   *  result) match canConnectOffsets().
+   *
+   *  @param cspace The configuration space, laid out as described by Cells.
+   *  @param costs The traversal cost of each cell (CV_32FC1, same size as cspace).
+   *  @param start The starting position.
+   *  @param end The ending position.
+   *  @param meanCost Set to the mean cost of the cells on the line, if connected.
+   *  @return bool - TRUE if there is nothing blocking the path between
+   *                 start and end.
+   */
+  static bool canConnectOffsets(const cv::Mat &cspace, const cv::Mat &costs,
+                                cv::Point start, cv::Point end, double &meanCost){
+    typedef typename Cells::cell cell;
+
+    if(!inBounds(cspace, start) || !inBounds(cspace, end)){
+      return false;
+    }
+
+    const cell *cells = cspace.ptr<cell>(0);
+    const float *costCells = costs.ptr<float>(0);
+
+    double total = 0;
+    unsigned int visited = 0;
+    bool connected = walkOffsets(start, end, cspace.step / sizeof(cell), costs.step / sizeof(float),
+                                 [&](ptrdiff_t offset, ptrdiff_t costOffset){
+      if(!Cells::isFree(cells, offset)){
+        return false;
+      }
+
+      total += costCells[costOffset];
+      visited++;
+      return true;
+    });
+
+    if(connected){
+      meanCost = total / visited;
+    }
+
+    return connected;
+  }
+
+private:
+  static bool inBounds(const cv::Mat &cspace, cv::Point p){
+    return p.x >= 0 && p.y >= 0 && p.x < Cells::width(cspace) && p.y < Cells::height(cspace);
+  }
+};
+
+#endif // CELLCHECKER_H
@@ -0,0 +1,463 @@
+/*! @file
+ *
+ *  @brief A contraction hierarchy of a Graph, for fast shortest path queries.
+ *
+ *  @author agent
+ *  @date 17-10-2026
+*/
+#include "contractionhierarchy.h"
+
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <string>
+
+ContractionHierarchy::ContractionHierarchy(): shortcuts_(0), lowest_(0)
+{
+}
+
+void ContractionHierarchy::clear(){
+  rank_.clear();
+  up_.clear();
+  shortcuts_ = 0;
+  lowest_ = 0;
+}
+
+bool ContractionHierarchy::empty() const{
+  return rank_.empty();
+}
+
+unsigned long ContractionHierarchy::shortcuts() const{
+  return shortcuts_;
+}
+
+bool ContractionHierarchy::contains(vertex v) const{
+  return v < rank_.size() && rank_[v] != CH_NO_RANK;
+}
+
+void ContractionHierarchy::build(const Graph &graph){
+  typedef std::pair<int, vertex> entry;
+
+  clear();
+  if(graph.container().empty()){
+    return;
+  }
+
+  size_t size = graph.container().rbegin()->first + 1;
+  rank_.assign(size, CH_NO_RANK);
+  up_.assign(size, std::vector<TArc>());
+
+  //The graph left to contract, shortcuts are added to it as verticies are removed
+  std::vector<std::vector<TArc>> remaining(size);
+  for(auto const &node: graph.container()){
+    for(auto const &e: node.second){
+      remaining[node.first].push_back(TArc{e.first, e.second, e.first});
+    }
+  }
+
+  std::vector<int> deleted(size, 0);  //Neighbours of each vertex already contracted
+  TSearchWorkspace witness;
+
+  //The edge difference counts double, as it matters most to the size of the hierarchy
+  auto priority = [&](vertex v){
+    return 2 * ((int)contract(remaining, v, witness, false) - (int)remaining[v].size()) + deleted[v];
+  };
+
+  std::vector<entry> heap;
+  for(auto const &node: graph.container()){
+    heap.push_back(entry(priority(node.first), node.first));
+  }
+  std::make_heap(heap.begin(), heap.end(), std::greater<entry>());
+
+  int next = 0;
+  while(!heap.empty()){
+    std::pop_heap(heap.begin(), heap.end(), std::greater<entry>());
+    vertex v = heap.back().second;
+    heap.pop_back();
+
+    //Contracting its neighbours may have made v more important, if so put it back
+    int current = priority(v);
+    if(!heap.empty() && current > heap.front().first){
+      heap.push_back(entry(current, v));
+      std::push_heap(heap.begin(), heap.end(), std::greater<entry>());
+      continue;
+    }
+
+    shortcuts_ += contract(remaining, v, witness, true);
+    rank_[v] = next++;
+
+    //Everything v is still joined to is contracted later, so ranks higher
+    up_[v] = remaining[v];
+    for(auto const &arc: remaining[v]){
+      std::vector<TArc> &back = remaining[arc.to];
+      back.erase(std::remove_if(back.begin(), back.end(), [v](const TArc &a){ return a.to == v; }), back.end());
+      deleted[arc.to]++;
+    }
+
+    remaining[v].clear();
+    remaining[v].shrink_to_fit();
+  }
+}
+
+unsigned int ContractionHierarchy::contract(std::vector<std::vector<TArc>> &remaining, vertex v,
+                                            TSearchWorkspace &witness, bool add){
+  unsigned int needed = 0;
+
+  //Shortcuts change remaining[v]'s neighbours' arcs, not v's, so a copy isn't needed
+  const std::vector<TArc> &arcs = remaining[v];
+
+  for(auto const &in: arcs){
+    //Each pair of neighbours is considered once, from the lower vertex
+    weight limit = -1;
+    for(auto const &out: arcs){
+      if(out.to > in.to){
+        limit = std::max(limit, in.w + out.w);
+      }
+    }
+
+    if(limit < 0){
+      continue; //No pairs left for this neighbour
+    }
+
+    witnessSearch(remaining, in.to, v, limit, witness);
+
+    for(auto const &out: arcs){
+      if(out.to <= in.to){
+        continue;
+      }
+
+      //Only needed if the path through v is the only shortest path
+      if(witness.distance(out.to) > in.w + out.w){
+        needed++;
+
+        if(add){
+          addShortcut(remaining, in.to, out.to, in.w + out.w, v);
+        }
+      }
+    }
+  }
+
+  return needed;
+}
+
+void ContractionHierarchy::witnessSearch(const std::vector<std::vector<TArc>> &remaining, vertex source,
+                                         vertex avoid, weight limit, TSearchWorkspace &witness){
+  typedef std::pair<weight, vertex> entry;
+
+  witness.reset(remaining.size());
+  witness.reach(source, 0, source);
+  witness.heap.push_back(entry(0, source));
+
+  while(!witness.heap.empty() && witness.settled < CH_WITNESS_SETTLE_LIMIT){
+    std::pop_heap(witness.heap.begin(), witness.heap.end(), std::greater<entry>());
+    entry top = witness.heap.back();
+    witness.heap.pop_back();
+
+    if(top.first > limit){
+      break; //Every witness that is needed has been found
+    }
+
+    if(witness.isClosed(top.second)){
+      continue;
+    }
+    witness.close(top.second);
+
+    for(auto const &arc: remaining[top.second]){
+      if(arc.to == avoid){
+        continue;
+      }
+
+      weight alt = top.first + arc.w;
+      if(alt < witness.distance(arc.to)){
+        witness.reach(arc.to, alt, top.second);
+        witness.heap.push_back(entry(alt, arc.to));
+        std::push_heap(witness.heap.begin(), witness.heap.end(), std::greater<entry>());
+      }
+    }
+  }
+}
+
+void ContractionHierarchy::addShortcut(std::vector<std::vector<TArc>> &remaining, vertex v, vertex u,
+                                       weight w, vertex middle){
+  for(auto const &ends: {std::make_pair(v, u), std::make_pair(u, v)}){
+    std::vector<TArc> &arcs = remaining[ends.first];
+    auto const existing = std::find_if(arcs.begin(), arcs.end(),
+                                       [&ends](const TArc &a){ return a.to == ends.second; });
+
+    if(existing == arcs.end()){
+      arcs.push_back(TArc{ends.second, w, middle});
+    } else if(w < existing->w){
+      existing->w = w;
+      existing->middle = middle;
+    }
+  }
+}
+
+bool ContractionHierarchy::attach(vertex v, vertex u, weight w){
+  //Nothing has an arc down to an attached vertex, so it can only ever be an end of a path
+  if(!contains(u) || rank_[u] < 0 || contains(v)){
+    return false;
+  }
+
+  if(rank_.size() <= v){
+    rank_.resize(v + 1, CH_NO_RANK);
+    up_.resize(v + 1);
+  }
+
+  rank_[v] = --lowest_;
+  up_[v].push_back(TArc{u, w, u});
+
+  return true;
+}
+
+const TArc *ContractionHierarchy::findArc(vertex v, vertex u) const{
+  vertex lower = rank_[v] < rank_[u] ? v : u;
+  vertex higher = lower == v ? u : v;
+
+  for(auto const &arc: up_[lower]){
+    if(arc.to == higher){
+      return &arc;
+    }
+  }
+
+  return nullptr;
+}
+
+void ContractionHierarchy::unpack(vertex v, vertex u, std::vector<vertex> &path) const{
+  const TArc *arc = findArc(v, u);
+
+  if(arc->middle == arc->to){
+    path.push_back(u); //An edge of the graph
+    return;
+  }
+
+  unpack(v, arc->middle, path);
+  unpack(arc->middle, u, path);
+}
+
+std::vector<vertex> ContractionHierarchy::shortestPath(vertex start, vertex goal,
+                                                       TSearchWorkspace &forward, TSearchWorkspace &backward) const{
+  std::vector<vertex> path;
+  shortestPath(start, goal, forward, backward, path);
+  return path;
+}
+
+void ContractionHierarchy::shortestPath(vertex start, vertex goal, TSearchWorkspace &forward,
+                                        TSearchWorkspace &backward, std::vector<vertex> &path) const{
+  typedef std::pair<weight, vertex> entry;
+
+  path.clear();
+  if(start == goal || !contains(start) || !contains(goal)){
+    return;
+  }
+
+  forward.reset(rank_.size());
+  backward.reset(rank_.size());
+  forward.reach(start, 0, start);
+  forward.heap.push_back(entry(0, start));
+  backward.reach(goal, 0, goal);
+  backward.heap.push_back(entry(0, goal));
+
+  weight best = std::numeric_limits<weight>::infinity();
+  vertex meet = start;
+
+  //Alternate between the searches, always advancing the one that is closer
+  while(!forward.heap.empty() || !backward.heap.empty()){
+    bool isForward = backward.heap.empty() ||
+                     (!forward.heap.empty() && forward.heap.front().first <= backward.heap.front().first);
+    TSearchWorkspace &search = isForward ? forward : backward;
+    const TSearchWorkspace &other = isForward ? backward : forward;
+
+    std::pop_heap(search.heap.begin(), search.heap.end(), std::greater<entry>());
+    entry top = search.heap.back();
+    search.heap.pop_back();
+
+    if(top.first >= best){
+      search.heap.clear(); //Nothing further up can be on a shorter path
+      continue;
+    }
+
+    vertex v = top.second;
+    if(search.isClosed(v)){
+      continue;
+    }
+    search.close(v);
+
+    if(top.first + other.distance(v) < best){
+      best = top.first + other.distance(v);
+      meet = v;
+    }
+
+    //If a higher neighbour is closer by going back down to v, the shortest path doesn't climb through v
+    bool stalled = false;
+    for(auto const &arc: up_[v]){
+      if(search.distance(arc.to) + arc.w < top.first){
+        stalled = true;
+        break;
+      }
+    }
+
+    if(stalled){
+      continue;
+    }
+
+    for(auto const &arc: up_[v]){
+      weight alt = top.first + arc.w;
+      if(alt < search.distance(arc.to)){
+        search.reach(arc.to, alt, v);
+        search.heap.push_back(entry(alt, arc.to));
+        std::push_heap(search.heap.begin(), search.heap.end(), std::greater<entry>());
+      }
+    }
+  }
+
+  if(best == std::numeric_limits<weight>::infinity()){
+    return;
+  }
+
+  //Arcs unpack the same either way, so the forward search is unpacked from
+  //where they meet back down to start and reversed, then the backward one appended
+  path.push_back(meet);
+  for(vertex v = meet; v != start; v = forward.parents[v]){
+    unpack(v, forward.parents[v], path);
+  }
+  std::reverse(path.begin(), path.end());
+
+  for(vertex v = meet; v != goal; v = backward.parents[v]){
+    unpack(v, backward.parents[v], path);
+  }
+}
+
+void ContractionHierarchy::save(std::ostream &out) const{
+  unsigned int verticies = 0;
+  for(auto const &r: rank_){
+    verticies += (r != CH_NO_RANK);
+  }
+
+  out << std::setprecision(17);
+  out << "hierarchy " << rank_.size() << " " << verticies << " " << shortcuts_ << " " << lowest_ << "\n";
+
+  for(vertex v = 0; v < rank_.size(); v++){
+    if(rank_[v] == CH_NO_RANK){
+      continue;
+    }
+
+    out << v << " " << rank_[v] << " " << up_[v].size();
+    for(auto const &arc: up_[v]){
+      out << " " << arc.to << " " << arc.w << " " << arc.middle;
+    }
+    out << "\n";
+  }
+}
+
+bool ContractionHierarchy::load(std::istream &in){
+  std::string tag;
+  size_t size;
+  unsigned int verticies;
+  unsigned long shortcuts;
+  int lowest;
+
+  if(!(in >> tag >> size >> verticies >> shortcuts >> lowest) || tag != "hierarchy"){
+    return false;
+  }
+
+  std::vector<int> rank(size, CH_NO_RANK);
+  std::vector<std::vector<TArc>> up(size);
+
+  for(unsigned int i = 0; i < verticies; i++){
+    vertex v;
+    size_t arcs;
+    if(!(in >> v) || v >= size || !(in >> rank[v] >> arcs)){
+      return false;
+    }
+
+    for(size_t a = 0; a < arcs; a++){
+      TArc arc;
+      if(!(in >> arc.to >> arc.w >> arc.middle) || arc.to >= size || arc.middle >= size){
+        return false;
+      }
+      up[v].push_back(arc);
+    }
+  }
+
+  if(!consistent(rank, up)){
+    return false;
+  }
+
+  rank_.swap(rank);
+  up_.swap(up);
+  shortcuts_ = shortcuts;
+  lowest_ = lowest;
+
+  return true;
+}
+
+bool ContractionHierarchy::consistent(const std::vector<int> &rank, const std::vector<std::vector<TArc>> &up){
+  auto ranked = [&rank](vertex v){ return rank[v] != CH_NO_RANK; };
+  auto hasArc = [&up](vertex lower, vertex higher){
+    return std::find_if(up[lower].begin(), up[lower].end(),
+                        [higher](const TArc &a){ return a.to == higher; }) != up[lower].end();
+  };
+
+  for(vertex v = 0; v < rank.size(); v++){
+    if(!ranked(v) && !up[v].empty()){
+      return false;
+    }
+
+    for(auto const &arc: up[v]){
+      if(!ranked(arc.to) || rank[arc.to] <= rank[v]){
+        return false;
+      }
+
+      if(arc.middle == arc.to){
+        continue; //An edge of the graph
+      }
+
+      //unpack() follows the arcs up from middle to both ends, which must rank lower still
+      if(!ranked(arc.middle) || rank[arc.middle] >= rank[v] ||
+         !hasArc(arc.middle, v) || !hasArc(arc.middle, arc.to)){
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool ContractionHierarchy::matches(const Graph &graph) const{
+  if(empty()){
+    return true;
+  }
+
+  if(graph.container().empty() || rank_.size() > graph.container().rbegin()->first + 1){
+    return false;
+  }
+
+  //Every vertex with an edge must be in the hierarchy, or it couldn't be searched from
+  for(auto const &node: graph.container()){
+    if(!node.second.empty() && !contains(node.first)){
+      return false;
+    }
+  }
+
+  for(vertex v = 0; v < up_.size(); v++){
+    for(auto const &arc: up_[v]){
+      if(arc.middle == arc.to && graph.getWeight(v, arc.to) != arc.w){
+        return false;
+      }
+    }
+  }
+
+  //Every edge must be an arc (or have a shortcut no longer than it), otherwise
+  //queries would miss it and return longer paths than a search of the graph
+  for(auto const &node: graph.container()){
+    for(auto const &e: node.second){
+      const TArc *arc = findArc(node.first, e.first);
+      if(arc == nullptr || arc->w > e.second){
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
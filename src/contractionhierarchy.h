@@ -0,0 +1,220 @@
+/*! @file
+ *
+ *  @brief A contraction hierarchy of a Graph, for fast shortest path queries.
+ *
+ *  Verticies are contracted one at a time, least important first. Contracting
+ *  a vertex adds a shortcut between each pair of its neighbours whose only
+ *  shortest path ran through it, so the rest of the graph keeps its distances.
+ *  The order each vertex was contracted in is its rank. A query searches only
+ *  upwards (towards higher ranks) from both the start and the goal, which meet
+ *  near the top, so few verticies are visited even in very large graphs.
+ *
+ *  The hierarchy is built once for a graph that doesn't change, and can be
+ *  saved and loaded again with it.
+ *
+ *  @author agent
+ *  @date 17-10-2026
+*/
+#ifndef CONTRACTIONHIERARCHY_H
+#define CONTRACTIONHIERARCHY_H
+
+#include "graph.h"
+
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+const unsigned int CH_WITNESS_SETTLE_LIMIT = 100; /*!< The max verticies settled by each witness search while contracting */
+const int CH_NO_RANK = std::numeric_limits<int>::min(); /*!< The rank of a vertex that isn't in the hierarchy */
+
+struct TArc /*!< An arc of a contraction hierarchy, from a vertex up to a higher ranked one */
+{
+  vertex to;      /*!< The higher ranked vertex */
+  weight w;       /*!< The weight of the arc */
+  vertex middle;  /*!< The vertex a shortcut bypasses, or to if the arc is an edge of the graph */
+};
+
+class ContractionHierarchy
+{
+public:
+  /*! @brief Constructor for an empty ContractionHierarchy.
+   *
+   */
+  ContractionHierarchy();
+
+  /*! @brief Contracts every vertex of a graph, replacing the previous hierarchy.
+   *
+   *  Verticies are ordered by twice their edge difference (shortcuts added less
+   *  edges removed) plus the neighbours already contracted, which keeps the
+   *  hierarchy shallow and spread evenly. Priorities are updated lazily, as
+   *  each vertex reaches the top of the queue. A shortcut is only skipped if
+   *  a witness search (bounded by CH_WITNESS_SETTLE_LIMIT) finds a path no
+   *  longer than it, so a bounded search only costs extra shortcuts.
+   *
+   *  @param graph The graph to build the hierarchy of.
+   */
+  void build(const Graph &graph);
+
+  /*! @brief Adds a vertex below every other, joined to a vertex of the hierarchy.
+   *
+   *  Used for a start or goal joined to the graph by a single edge after the
+   *  hierarchy was built. Paths to and from the vertex are found exactly, but
+   *  no path can pass through it, so a vertex with more edges can't be attached.
+   *
+   *  @param v The new vertex, which must have no other edges.
+   *  @param u The vertex of the hierarchy it has an edge to.
+   *  @param w The weight of the edge.
+   *  @return bool - FALSE if v is already in the hierarchy, or u was attached (or isn't in it).
+   */
+  bool attach(vertex v, vertex u, weight w);
+
+  /*! @brief Checks if a vertex is in the hierarchy.
+   *
+   *  @param v The vertex.
+   *  @return bool - TRUE if v was contracted or attached.
+   */
+  bool contains(vertex v) const;
+
+  /*! @brief Indicates if there is a hierarchy.
+   *
+   *  @return bool - TRUE if nothing has been built or loaded.
+   */
+  bool empty() const;
+
+  /*! @brief Discards the hierarchy.
+   *
+   */
+  void clear();
+
+  /*! @brief Gets the amount of shortcuts the hierarchy added to the graph.
+   *
+   *  @return unsigned long - The amount of shortcuts.
+   */
+  unsigned long shortcuts() const;
+
+  /*! @brief Finds the shortest path between two verticies in the hierarchy.
+   *
+   *  The two searches only follow arcs up the hierarchy, and stop once they
+   *  can't improve the shortest path through a vertex both have reached.
+   *  A vertex that a higher neighbour reaches more cheaply is stalled (its
+   *  arcs aren't followed), as no shortest path climbs through it. Shortcuts are then unpacked into the edges of the graph. As the
+   *  hierarchy is only read, several searches may run concurrently provided
+   *  each has its own workspaces.
+   *
+   *  @param start The start vertex.
+   *  @param goal The end vertex, the goal to reach.
+   *  @param forward The scratch space to search up from start with.
+   *  @param backward The scratch space to search up from goal with.
+   *  @return vector - The shortest path between start and goal, empty if there is no path.
+   */
+  std::vector<vertex> shortestPath(vertex start, vertex goal,
+                                   TSearchWorkspace &forward, TSearchWorkspace &backward) const;
+
+  /*! @brief Finds the shortest path between two verticies, into a caller supplied path.
+   *
+   *  As above, but the path is written in place, so a path reused between
+   *  queries is only allocated while it grows.
+   *
+   *  @param start The start vertex.
+   *  @param goal The end vertex, the goal to reach.
+   *  @param forward The scratch space to search up from start with.
+   *  @param backward The scratch space to search up from goal with.
+   *  @param path Replaced with the shortest path between start and goal, empty if there is no path.
+   */
+  void shortestPath(vertex start, vertex goal, TSearchWorkspace &forward, TSearchWorkspace &backward,
+                    std::vector<vertex> &path) const;
+
+  /*! @brief Writes the hierarchy as text.
+   *
+   *  @param out The stream to write to.
+   */
+  void save(std::ostream &out) const;
+
+  /*! @brief Reads a hierarchy written by save(), replacing this one.
+   *
+   *  The arcs read must be consistent (see consistent()), so a truncated or
+   *  corrupt file can't make a query unpack an arc that isn't there.
+   *
+   *  @param in The stream to read from.
+   *  @return bool - FALSE if the hierarchy couldn't be read, in which case this one is unchanged.
+   */
+  bool load(std::istream &in);
+
+  /*! @brief Checks the hierarchy could have been built from a graph.
+   *
+   *  Used to check a loaded hierarchy belongs to the graph loaded with it.
+   *  Every vertex with an edge must be in the hierarchy, every arc that isn't
+   *  a shortcut must be an edge of the graph with the same weight, and every
+   *  edge of the graph must have an arc between its ends no longer than it.
+   *
+   *  @param graph The graph.
+   *  @return bool - TRUE if the hierarchy is empty, or matches graph.
+   */
+  bool matches(const Graph &graph) const;
+
+private:
+  std::vector<int> rank_;               /*!< The order each vertex was contracted in (attached verticies are negative), indexed by vertex */
+  std::vector<std::vector<TArc>> up_;   /*!< The arcs from each vertex up to higher ranked verticies */
+  unsigned long shortcuts_;             /*!< The amount of shortcuts added */
+  int lowest_;                          /*!< The rank of the last attached vertex, 0 if none */
+
+  /*! @brief Counts (and adds) the shortcuts needed to contract a vertex.
+   *
+   *  @param remaining The arcs between the verticies not yet contracted.
+   *  @param v The vertex to contract.
+   *  @param witness Scratch space for the witness searches.
+   *  @param add TRUE to add the shortcuts to remaining, otherwise they are only counted.
+   *  @return unsigned int - The amount of shortcuts needed.
+   */
+  unsigned int contract(std::vector<std::vector<TArc>> &remaining, vertex v,
+                        TSearchWorkspace &witness, bool add);
+
+  /*! @brief Searches for the shortest paths from a vertex, avoiding another.
+   *
+   *  @param remaining The arcs between the verticies not yet contracted.
+   *  @param source The vertex to search from.
+   *  @param avoid The vertex being contracted.
+   *  @param limit Paths longer than this aren't needed.
+   *  @param witness The scratch space to search with, holding the distances found.
+   */
+  static void witnessSearch(const std::vector<std::vector<TArc>> &remaining, vertex source,
+                            vertex avoid, weight limit, TSearchWorkspace &witness);
+
+  /*! @brief Adds a shortcut in both directions, unless there is already an arc as short.
+   *
+   *  @param remaining The arcs between the verticies not yet contracted.
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @param w The weight of the shortcut.
+   *  @param middle The vertex being contracted.
+   */
+  static void addShortcut(std::vector<std::vector<TArc>> &remaining, vertex v, vertex u, weight w, vertex middle);
+
+  /*! @brief Checks arcs only lead up the hierarchy, and each shortcut can be unpacked.
+   *
+   *  @param rank The rank of each vertex.
+   *  @param up The arcs from each vertex up to higher ranked verticies.
+   *  @return bool - TRUE if every arc leads to a higher ranked vertex, and the middle of
+   *                 each shortcut ranks lower than both its ends and has arcs up to them.
+   */
+  static bool consistent(const std::vector<int> &rank, const std::vector<std::vector<TArc>> &up);
+
+  /*! @brief Finds the arc between two verticies, which belongs to the lower ranked one.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @return TArc* - The arc, or nullptr if there is none.
+   */
+  const TArc *findArc(vertex v, vertex u) const;
+
+  /*! @brief Appends the edges of the graph an arc stands for to a path.
+   *
+   *  @param v The vertex the arc leaves, already on the path.
+   *  @param u The vertex the arc reaches.
+   *  @param path The path to append to, ending with u.
+   */
+  void unpack(vertex v, vertex u, std::vector<vertex> &path) const;
+};
+
+#endif // CONTRACTIONHIERARCHY_H
@@ -20,6 +20,11 @@ Graph::Graph(unsigned int maxNeighbours): maxNeighbours_(maxNeighbours)
 {
 }
 
+void Graph::setMaxNeighbours(unsigned int maxNeighbours)
+{
+  maxNeighbours_ = maxNeighbours;
+}
+
 bool Graph::addVertex(const vertex v)
 {
   if (container_.find(v) != container_.end()){
@@ -39,33 +44,61 @@ bool Graph::removeVertex(const vertex v)
     return false;
   }
 
-  container_.erase(conIter);
-
-  //Make sure we remove edges with this vertex as well
+  //Make sure we remove edges with this vertex as well, this relies on
+  //the vertex still being in the container to find its neighbours
   removeEdgesWithVertex(v);
+  container_.erase(conIter);
   return true;
 }
 
 bool Graph::addEdge(const vertex v, const vertex u, const weight w)
 {
-  if(container_.find(v) == container_.end() || container_.find(u) == container_.end()){
+  auto const vIter = container_.find(v);
+  auto const uIter = container_.find(u);
+  if(vIter == container_.end() || uIter == container_.end()){
     return false; //All verticies must be present when adding an edge
   }
 
   //Check the verticies are not at their neighbour limits
-  if(container_.find(v)->second.size() >= maxNeighbours_ ||
-     container_.find(u)->second.size() >= maxNeighbours_){
+  if(vIter->second.size() >= maxNeighbours_ || uIter->second.size() >= maxNeighbours_){
+    return false;
+  }
+
+  //Check if there is already an edge between these neighbours. As the graph
+  //is undirected, it is enough to look in the adjacency of one of them.
+  if(findEdge(vIter->second, u) != vIter->second.end()){
+    return false;
+  }
+
+  vIter->second.insert(edge(u, w));
+  uIter->second.insert(edge(v, w));
+
+  return true;
+}
+
+bool Graph::removeEdge(const vertex v, const vertex u)
+{
+  auto const vIter = container_.find(v);
+  auto const uIter = container_.find(u);
+  if(vIter == container_.end() || uIter == container_.end()){
     return false;
   }
 
-  //Check if there is already an edge between these neighbours
-  auto vEdges = container_.find(v)->second;
-  if(find_if(vEdges.begin(), vEdges.end(), [u](const edge &e){ return e.first == u;}) != vEdges.end()){
+  auto const e = findEdge(vIter->second, u);
+  if(e == vIter->second.end()){
     return false;
   }
 
-  auto uEdges = container_.find(u)->second;
-  if(find_if(uEdges.begin(), uEdges.end(), [v](const edge &e){ return e.first == v;}) != uEdges.end()){
+  vIter->second.erase(e);
+  uIter->second.erase(findEdge(uIter->second, v));
+
+  return true;
+}
+
+bool Graph::setWeight(const vertex v, const vertex u, const weight w)
+{
+  //The weight is part of each edge's ordering, so the edge is replaced
+  if(!removeEdge(v, u)){
     return false;
   }
 
@@ -75,113 +108,344 @@ bool Graph::addEdge(const vertex v, const vertex u, const weight w)
   return true;
 }
 
-void Graph::removeEdgesWithVertex(const vertex v)
+bool Graph::hasEdge(const vertex v, const vertex u) const
 {
-  std::set<edge>::iterator it;
+  auto const vIter = container_.find(v);
+  if(vIter == container_.end()){
+    return false;
+  }
+
+  return findEdge(vIter->second, u) != vIter->second.end();
+}
 
-  if(container_.find(v) != container_.end()){
-    //It might still be in the container, clear all its edges
-    container_.find(v)->second.clear();
+weight Graph::getWeight(const vertex v, const vertex u) const
+{
+  auto const vIter = container_.find(v);
+  if(vIter == container_.end()){
+    return std::numeric_limits<weight>::infinity();
   }
 
-  //All other vertex edges
-  for(auto &u: container_){
-    for(it=u.second.begin(); it != u.second.end();){
-      edge e = *it;
-      if(e.first == v)
-        u.second.erase(it++);
-      else
-        ++it;
-    }
+  auto const e = findEdge(vIter->second, u);
+  if(e == vIter->second.end()){
+    return std::numeric_limits<weight>::infinity();
   }
+
+  return e->second;
 }
 
-/*! @brief Finds the closest vertex in a queue.
- *
- *  @param distances This contains the distance between each vertex and some pre-determined start.
- *  @param q The queue of available verticies to search within.
- *  @return vertex - The next closest vertex.
- *
- *  @note This assumes that q is non-empty.
- */
-vertex closestVertex(std::map<vertex, double> distances, std::vector<vertex> q){
-  vertex minVertex = q.at(0);
-  double minDist = std::numeric_limits<double>::infinity();
-
-  for(auto const &v: q){
-    if(distances[v] < minDist){
-      minVertex = v;
-      minDist = distances[v];
+void Graph::removeEdgesWithVertex(const vertex v)
+{
+  auto const vIter = container_.find(v);
+  if(vIter == container_.end()){
+    return; //Unknown vertex, so no other vertex can have an edge to it
+  }
+
+  //The graph is undirected, so the only verticies with a back-edge to v
+  //are v's own neighbours. Visit just those rather than the whole graph.
+  for(auto const &e: vIter->second){
+    auto const nIter = container_.find(e.first);
+    if(nIter == container_.end()){
+      continue;
+    }
+
+    auto const backEdge = findEdge(nIter->second, v);
+    if(backEdge != nIter->second.end()){
+      nIter->second.erase(backEdge);
     }
   }
 
-  return minVertex;
+  vIter->second.clear();
 }
 
-std::vector<vertex> Graph::constructPath(std::map<vertex, vertex> parents, vertex goal){
-  std::vector<vertex> path;
+edges::const_iterator Graph::findEdge(const edges &neighbours, const vertex u)
+{
+  //Edges are ordered by their neighbour first, so the lowest possible weight
+  //gives the first (and only) candidate for neighbour u
+  auto const it = neighbours.lower_bound(edge(u, -std::numeric_limits<weight>::infinity()));
+  if(it != neighbours.end() && it->first == u){
+    return it;
+  }
+
+  return neighbours.end();
+}
+
+bool Graph::isBlocked(const edgeSet *blocked, const vertex v, const vertex u)
+{
+  if(blocked == nullptr || blocked->empty()){
+    return false;
+  }
+
+  return blocked->count(v < u ? std::make_pair(v, u) : std::make_pair(u, v)) > 0;
+}
 
-  if(parents.find(goal) == parents.end()){
-      return path; //Goal has not been found
+void TSearchWorkspace::reset(size_t size){
+  if(distances.size() < size){
+    distances.resize(size);
+    parents.resize(size);
+    reached.resize(size, 0);
+    closed.resize(size, 0);
+  }
+
+  heap.clear();
+  settled = 0;
+  generation++;
+
+  if(generation == 0){
+    //The generation has wrapped, so old stamps could look current again
+    std::fill(reached.begin(), reached.end(), 0);
+    std::fill(closed.begin(), closed.end(), 0);
+    generation = 1;
+  }
+}
+
+void Graph::constructPath(const TSearchWorkspace &workspace, vertex start, vertex goal, std::vector<vertex> &path) const{
+  path.clear();
+
+  if(goal == start || workspace.distance(goal) == std::numeric_limits<weight>::infinity()){
+      return; //Goal has not been found
   }
 
   path.push_back(goal);
 
-  while(parents.find(path.back()) != parents.end()){
-    path.push_back(parents.at(path.back()));
+  while(path.back() != start){
+    path.push_back(workspace.parents[path.back()]);
   }
 
   std::reverse(path.begin(), path.end());
+}
+
+std::vector<vertex> Graph::shortestPath(const vertex start, const vertex goal) const{
+  TSearchWorkspace workspace;
+  return shortestPath(start, goal, workspace);
+}
+
+std::vector<vertex> Graph::shortestPath(const vertex start, const vertex goal, TSearchWorkspace &workspace,
+                                        const edgeSet *blocked) const{
+  std::vector<vertex> path;
+  shortestPath(start, goal, workspace, blocked, path);
   return path;
 }
 
-std::vector<vertex> Graph::shortestPath(const vertex start, const vertex goal){
-  std::map<vertex, vertex> parents;   //used to reconstruct the shortest path
-  std::map<vertex, double> distances; //This map contains the distances between various nodes and the start node.
-  std::vector<vertex> queue, path;
+void Graph::shortestPath(const vertex start, const vertex goal, TSearchWorkspace &workspace,
+                         const edgeSet *blocked, std::vector<vertex> &path) const{
+  typedef std::pair<weight, vertex> entry;
 
   if(container_.find(start) == container_.end() ||
      container_.find(goal) == container_.end()){
-    return path; //Empty path between two unknown verticies
+    path.clear();
+    return; //Empty path between two unknown verticies
   }
 
-  //The below algo is an implementation of Dijkstra's shortest path
-  for(auto const &v: container_){
-    //Initially, distances to other verticies is equal to infinity
-    distances.insert(std::pair<vertex, double>(v.first, std::numeric_limits<double>::infinity()));
-    queue.push_back(v.first);
-  }
+  //The below algo is an implementation of Dijkstra's shortest path. Verticies
+  //index the flat workspace arrays, so size them to the largest vertex.
+  //Resetting is constant time, verticies that aren't reached are never touched.
+  workspace.reset(container_.rbegin()->first + 1);
 
   //For the start position the distance to itself is 0
-  distances[start] = 0;
+  workspace.reach(start, 0, start);
+  workspace.heap.push_back(entry(0, start));
 
-  while(!queue.empty())
+  while(!workspace.heap.empty())
   {
-    vertex v = closestVertex(distances, queue);
-    edges neighbours = container_[v];
+    //Take the closest vertex that hasn't been visited yet
+    std::pop_heap(workspace.heap.begin(), workspace.heap.end(), std::greater<entry>());
+    vertex v = workspace.heap.back().second;
+    workspace.heap.pop_back();
+
+    if(workspace.isClosed(v)){
+      continue; //A stale entry, v was already reached by a shorter path
+    }
+    workspace.close(v);
 
-    for(auto const &n: neighbours)
+    if(v == goal){
+      break; //No point processing the whole graph if a path to the goal is found
+    }
+
+    weight dv = workspace.distance(v);
+    for(auto const &n: container_.find(v)->second)
     {
-      double alt = distances[v] + n.second; //neighbour distance + weight
-      if(alt < distances[n.first]){
+      if(isBlocked(blocked, v, n.first)){
+        continue;
+      }
+
+      weight alt = dv + n.second; //neighbour distance + weight
+      if(alt < workspace.distance(n.first)){
         //Update parent and distance if there is a shorter path
         //back to the start
-        distances[n.first] = alt;
-        parents[n.first] = v;
+        workspace.reach(n.first, alt, v);
+        workspace.heap.push_back(entry(alt, n.first));
+        std::push_heap(workspace.heap.begin(), workspace.heap.end(), std::greater<entry>());
       }
     }
+  }
 
-    queue.erase(std::remove(queue.begin(), queue.end(), v), queue.end());
+  constructPath(workspace, start, goal, path);
+}
 
-    if(std::find(queue.begin(), queue.end(), goal) == queue.end()){
-      break; //No point processing the whole graph if a path to the goal is found
+void TIncrementalSearch::reset(size_t size){
+  g.assign(size, std::numeric_limits<weight>::infinity());
+  rhs.assign(size, std::numeric_limits<weight>::infinity());
+  keys.assign(size, key());
+  queued.assign(size, false);
+  queue.clear();
+
+  active = false;
+  km = 0;
+  expansions = 0;
+}
+
+void TIncrementalSearch::grow(size_t size){
+  if(g.size() < size){
+    g.resize(size, std::numeric_limits<weight>::infinity());
+    rhs.resize(size, std::numeric_limits<weight>::infinity());
+    keys.resize(size);
+    queued.resize(size, false);
+  }
+}
+
+TIncrementalSearch::key Graph::searchKey(const TIncrementalSearch &search, vertex v){
+  weight d = std::min(search.g[v], search.rhs[v]);
+  return TIncrementalSearch::key(d + search.estimate(search.start, v) + search.km, d);
+}
+
+void Graph::updateVertex(TIncrementalSearch &search, vertex v) const{
+  if(v != search.goal){
+    //Removed verticies have no edges, so can't reach the goal
+    search.rhs[v] = std::numeric_limits<weight>::infinity();
+
+    auto const vIter = container_.find(v);
+    if(vIter != container_.end()){
+      for(auto const &n: vIter->second){
+        if(!isBlocked(search.blocked, v, n.first)){
+          search.rhs[v] = std::min(search.rhs[v], search.g[n.first] + n.second);
+        }
+      }
     }
   }
 
-  return constructPath(parents, goal);
+  if(search.queued[v]){
+    search.queue.erase(std::make_pair(search.keys[v], v));
+    search.queued[v] = false;
+  }
+
+  if(search.g[v] != search.rhs[v]){
+    search.keys[v] = searchKey(search, v);
+    search.queue.insert(std::make_pair(search.keys[v], v));
+    search.queued[v] = true;
+  }
+}
+
+void Graph::expand(TIncrementalSearch &search) const{
+  vertex start = search.start;
+
+  while(!search.queue.empty() &&
+        (search.queue.begin()->first < searchKey(search, start) || search.rhs[start] != search.g[start])){
+    TIncrementalSearch::key old = search.queue.begin()->first;
+    vertex v = search.queue.begin()->second;
+    search.expansions++;
+
+    //The start has moved since v was queued, so v's priority is now higher
+    TIncrementalSearch::key current = searchKey(search, v);
+    if(old < current){
+      search.queue.erase(search.queue.begin());
+      search.keys[v] = current;
+      search.queue.insert(std::make_pair(current, v));
+      continue;
+    }
+
+    auto const vIter = container_.find(v);
+    if(search.g[v] > search.rhs[v]){
+      //A shorter path was found, so v's neighbours may now go through it
+      search.g[v] = search.rhs[v];
+      search.queue.erase(search.queue.begin());
+      search.queued[v] = false;
+    } else {
+      //A path through v got longer, so v and its neighbours are recalculated
+      search.g[v] = std::numeric_limits<weight>::infinity();
+      updateVertex(search, v);
+    }
+
+    if(vIter != container_.end()){
+      for(auto const &n: vIter->second){
+        updateVertex(search, n.first);
+      }
+    }
+  }
+}
+
+std::vector<vertex> Graph::shortestPath(const vertex start, const vertex goal, TIncrementalSearch &search) const{
+  std::vector<vertex> path;
+
+  if(goal == start ||
+     container_.find(start) == container_.end() ||
+     container_.find(goal) == container_.end()){
+    return path;
+  }
+
+  size_t size = container_.rbegin()->first + 1;
+
+  if(!search.active || search.goal != goal){
+    //A new goal changes every distance, so the search is made from scratch
+    search.reset(size);
+    search.start = start;
+    search.goal = goal;
+    search.last = start;
+    search.rhs[goal] = 0;
+    updateVertex(search, goal);
+    search.active = true;
+  } else if(start != search.start){
+    //Rather than requeue everything, later priorities are offset by how far the start moved
+    search.km += search.estimate(search.last, start);
+    search.start = start;
+    search.last = start;
+  }
+
+  search.grow(size);
+  expand(search);
+
+  if(search.g[start] == std::numeric_limits<weight>::infinity()){
+    return path; //Goal can't be reached
+  }
+
+  //Descend the distances to the goal. Each step is to a vertex closer to the goal,
+  //the bound only guards against zero weight cycles.
+  path.push_back(start);
+  while(path.back() != goal && path.size() <= size){
+    vertex next = path.back();
+    weight best = std::numeric_limits<weight>::infinity();
+
+    for(auto const &n: container_.find(path.back())->second){
+      if(n.second + search.g[n.first] < best && !isBlocked(search.blocked, path.back(), n.first)){
+        best = n.second + search.g[n.first];
+        next = n.first;
+      }
+    }
+
+    if(best == std::numeric_limits<weight>::infinity()){
+      return std::vector<vertex>();
+    }
+
+    path.push_back(next);
+  }
+
+  if(path.back() != goal){
+    return std::vector<vertex>();
+  }
+
+  return path;
+}
+
+void Graph::repairEdge(const vertex v, const vertex u, TIncrementalSearch &search) const{
+  if(!search.active){
+    return; //Nothing to repair, the next search is made from scratch
+  }
+
+  search.grow(std::max(v, u) + 1);
+  updateVertex(search, v);
+  updateVertex(search, u);
 }
 
-std::map<vertex, edges> Graph::container() const{
+const std::map<vertex, edges> &Graph::container() const{
   return container_;
 }
 
@@ -14,6 +14,9 @@
 
 #include <set>
 #include <map>
+#include <cstddef>
+#include <functional>
+#include <limits>
 #include <utility>
 #include <vector>
 
@@ -21,6 +24,94 @@ typedef unsigned int vertex;            /*!< A vertex has a unique id within the
 typedef double weight;                  /*!< An edge weighting is non-negative */
 typedef std::pair<vertex, weight> edge; /*!< An edge points to a vertex and has a weighting */
 typedef std::set<edge> edges;           /*!< A list of edges (or neighbours) */
+typedef std::set<std::pair<vertex, vertex>> edgeSet; /*!< A set of undirected edges, each as (lower vertex, higher vertex) */
+
+struct TSearchWorkspace /*!< Scratch space for Graph::shortestPath, which can be reused between searches */
+{
+  std::vector<weight> distances;                /*!< Distance from the start to each vertex, indexed by vertex */
+  std::vector<vertex> parents;                  /*!< The previous vertex on the shortest path to each vertex */
+  std::vector<unsigned int> reached;            /*!< The search (generation) that last set a vertex's distance */
+  std::vector<unsigned int> closed;             /*!< The search (generation) that finalised a vertex's distance */
+  std::vector<std::pair<weight, vertex>> heap;  /*!< A min-heap of verticies to visit, by distance */
+  unsigned int generation = 0;                  /*!< The current search, entries stamped with any other are unset */
+  unsigned int settled = 0;                     /*!< The verticies closed by the current search, for profiling */
+
+  /*! @brief Prepares the workspace for a new search.
+   *
+   *  Rather than clearing every entry, the generation is advanced so all
+   *  existing entries become stale. The arrays only grow when the graph does.
+   *
+   *  @param size One more than the largest vertex that will be searched.
+   */
+  void reset(size_t size);
+
+  /*! @brief Returns the distance to a vertex in the current search.
+   *
+   *  @param v The vertex.
+   *  @return weight - The distance, infinity if it hasn't been reached.
+   */
+  weight distance(vertex v) const { return reached[v] == generation ? distances[v] : std::numeric_limits<weight>::infinity(); }
+
+  /*! @brief Sets the distance to (and parent of) a vertex in the current search.
+   *
+   *  @param v The vertex.
+   *  @param d The distance from the start.
+   *  @param parent The previous vertex on the path to v.
+   */
+  void reach(vertex v, weight d, vertex parent) { distances[v] = d; parents[v] = parent; reached[v] = generation; }
+
+  /*! @brief Indicates if a vertex's distance is final in the current search.
+   *
+   *  @param v The vertex.
+   *  @return bool - TRUE if v has been visited.
+   */
+  bool isClosed(vertex v) const { return closed[v] == generation; }
+
+  /*! @brief Marks a vertex's distance as final in the current search.
+   *
+   *  @param v The vertex.
+   */
+  void close(vertex v) { closed[v] = generation; settled++; }
+};
+
+struct TIncrementalSearch /*!< The state of Graph's incremental (D* Lite) search, kept so the next search can repair it */
+{
+  typedef std::pair<weight, weight> key;        /*!< A vertex's priority, compared lexicographically */
+
+  std::function<weight(vertex, vertex)> heuristic;  /*!< Never more than the distance between two verticies, zero if unset */
+  std::vector<weight> g;                        /*!< The distance from each vertex to the goal, as last expanded */
+  std::vector<weight> rhs;                      /*!< The distance from each vertex to the goal, looking one edge ahead */
+  std::vector<key> keys;                        /*!< The priority each queued vertex was queued with */
+  std::vector<bool> queued;                     /*!< TRUE if a vertex is in the queue */
+  std::set<std::pair<key, vertex>> queue;       /*!< Inconsistent verticies (g != rhs) to expand, by priority */
+  const edgeSet *blocked = nullptr;             /*!< Edges treated as absent (changes must be repaired), nullptr if none */
+  bool active = false;                          /*!< TRUE once a search has been made, so changes must be repaired */
+  vertex start = 0;                             /*!< The start of the last search */
+  vertex goal = 0;                              /*!< The goal of the last search */
+  vertex last = 0;                              /*!< The start when the priorities were last offset (km) */
+  weight km = 0;                                /*!< How far the start has moved, added to every new priority */
+  unsigned long expansions = 0;                 /*!< Verticies expanded since the search was made, for profiling */
+
+  /*! @brief Forgets the previous search, so the next one starts from scratch.
+   *
+   *  @param size One more than the largest vertex that will be searched.
+   */
+  void reset(size_t size);
+
+  /*! @brief Grows the search to include new verticies, which are unreached.
+   *
+   *  @param size One more than the largest vertex that will be searched.
+   */
+  void grow(size_t size);
+
+  /*! @brief Returns the heuristic distance between two verticies.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @return weight - The heuristic, or zero if there is none.
+   */
+  weight estimate(vertex v, vertex u) const { return heuristic ? heuristic(v, u) : 0; }
+};
 
 class Graph
 {
@@ -31,6 +122,14 @@ public:
    */
   Graph(unsigned int maxNeighbours);
 
+  /*! @brief Changes the max amount of neighbours a vertex can have.
+   *
+   *  Verticies that already have more neighbours keep them, but can't gain more.
+   *
+   *  @param maxNeighbours The max amount of neighbours a vertex can have.
+   */
+  void setMaxNeighbours(unsigned int maxNeighbours);
+
   /*! @brief Adds a vertex to the graph.
    *
    *  @param v The unique vertex to add to the graph.
@@ -48,6 +147,39 @@ public:
    */
   bool addEdge(const vertex v, const vertex u, const weight w);
 
+  /*! @brief Removes the edge between two verticies.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @return bool - Will return false if there is no edge between v and u.
+   */
+  bool removeEdge(const vertex v, const vertex u);
+
+  /*! @brief Changes the weight of the edge between two verticies.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @param w The new weight of the edge.
+   *  @return bool - Will return false if there is no edge between v and u.
+   */
+  bool setWeight(const vertex v, const vertex u, const weight w);
+
+  /*! @brief Checks if there is an edge between two verticies.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @return bool - TRUE if v and u are neighbours.
+   */
+  bool hasEdge(const vertex v, const vertex u) const;
+
+  /*! @brief Returns the weight of the edge between two verticies.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @return weight - The weight of the edge, or infinity if there is no edge.
+   */
+  weight getWeight(const vertex v, const vertex u) const;
+
   /*! @brief Finds the shortest path between two verticies in the graph.
    *
    *  This function uses Dijkstra's algorithm for finding the shortest
@@ -59,7 +191,64 @@ public:
    *                   the shortest path between start and goal. This
    *                   vector will be empty if there is no path.
    */
-  std::vector<vertex> shortestPath(const vertex start, const vertex goal);
+  std::vector<vertex> shortestPath(const vertex start, const vertex goal) const;
+
+  /*! @brief Finds the shortest path between two verticies using caller supplied scratch space.
+   *
+   *  Reusing a workspace avoids allocating and initialising it on every
+   *  search, so the cost of a search only depends on the verticies it reaches. As the graph
+   *  is only read, several searches may run concurrently provided each has
+   *  its own workspace and the graph is not modified.
+   *
+   *  @param start The start vertex.
+   *  @param goal The end vertex, the goal to reach.
+   *  @param workspace The scratch space to search with.
+   *  @param blocked Edges to treat as absent (e.g. crossing a transient obstacle), nullptr if none.
+   *  @return vector - The shortest path between start and goal, empty if there is no path.
+   */
+  std::vector<vertex> shortestPath(const vertex start, const vertex goal, TSearchWorkspace &workspace,
+                                   const edgeSet *blocked = nullptr) const;
+
+  /*! @brief Finds the shortest path between two verticies, into a caller supplied path.
+   *
+   *  As above, but the path is written in place, so a path reused between
+   *  searches is only allocated while it grows.
+   *
+   *  @param start The start vertex.
+   *  @param goal The end vertex, the goal to reach.
+   *  @param workspace The scratch space to search with.
+   *  @param blocked Edges to treat as absent, nullptr if none.
+   *  @param path Replaced with the shortest path between start and goal, empty if there is no path.
+   */
+  void shortestPath(const vertex start, const vertex goal, TSearchWorkspace &workspace,
+                    const edgeSet *blocked, std::vector<vertex> &path) const;
+
+  /*! @brief Finds the shortest path between two verticies, repairing a previous search.
+   *
+   *  This uses D* Lite, which searches back from the goal. While the goal
+   *  is unchanged, the previous search is kept: the start may move, and
+   *  edges that were changed (see repairEdge()) only cause the verticies
+   *  whose distance to the goal changed to be expanded again. The path
+   *  has the same weight as the one found by Dijkstra's algorithm.
+   *
+   *  @param start The start vertex.
+   *  @param goal The end vertex, the goal to reach.
+   *  @param search The previous search, which is updated.
+   *  @return vector - The shortest path between start and goal, empty if there is no path.
+   */
+  std::vector<vertex> shortestPath(const vertex start, const vertex goal, TIncrementalSearch &search) const;
+
+  /*! @brief Tells an incremental search that the edge between two verticies changed.
+   *
+   *  This must be called after an edge is added, removed or reweighted
+   *  (including by removing a vertex), for every search that is to be
+   *  repaired rather than made again. It does nothing if no search has been made.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @param search The search to repair.
+   */
+  void repairEdge(const vertex v, const vertex u, TIncrementalSearch &search) const;
 
   /*! @brief Checks if one is able to connect to a given vertex.
    *
@@ -75,7 +264,7 @@ public:
    *
    *  @return map<vertex, edges> - The container that represents the graph.
    */
-  std::map<vertex, edges> container() const;
+  const std::map<vertex, edges> &container() const;
 
   /*! @brief Remove a vertex from the graph.
    *
@@ -85,6 +274,8 @@ public:
 
   /*! @brief Removes edges associated with a vertex.
    *
+   *  Only the neighbours of the vertex are visited, so the cost is
+   *  proportional to the vertex's degree rather than the graph size.
    */
   void removeEdgesWithVertex(const vertex v);
 
@@ -99,13 +290,51 @@ private:
 
   /*! @brief Constructs a path between start and goal.
    *
-   *  @param parents Used to determine the parents of each node all the way back to the start.
+   *  @param workspace A completed search, whose parents lead from goal back to the start.
+   *  @param start The start vertex.
    *  @param goal The end vertex, the goal to reach.
-   *  @return vector - Will return a vector of verticies that represent
-   *                   the shortest path between start and goal. This
-   *                   vector will be empty if there is no path.
+   *  @param path Replaced with the verticies of the shortest path between start
+   *              and goal. This will be empty if there is no path.
+   */
+  void constructPath(const TSearchWorkspace &workspace, vertex start, vertex goal, std::vector<vertex> &path) const;
+
+  /*! @brief Finds the edge to a given neighbour within a list of edges.
+   *
+   *  @param neighbours The edges to search within.
+   *  @param u The neighbouring vertex to find.
+   *  @return const_iterator - The edge to u, or neighbours.end() if there is none.
+   */
+  static edges::const_iterator findEdge(const edges &neighbours, const vertex u);
+
+  /*! @brief Checks if an edge is within a set of blocked edges.
+   *
+   *  @param blocked The blocked edges, may be nullptr.
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @return bool - TRUE if the edge between v and u is blocked.
+   */
+  static bool isBlocked(const edgeSet *blocked, const vertex v, const vertex u);
+
+  /*! @brief Returns the priority of a vertex in an incremental search.
+   *
+   *  @param search The search.
+   *  @param v The vertex.
+   *  @return key - The priority, lowest is expanded first.
+   */
+  static TIncrementalSearch::key searchKey(const TIncrementalSearch &search, vertex v);
+
+  /*! @brief Recalculates a vertex's lookahead distance, and queues it if inconsistent.
+   *
+   *  @param search The search.
+   *  @param v The vertex.
+   */
+  void updateVertex(TIncrementalSearch &search, vertex v) const;
+
+  /*! @brief Expands verticies until the start's distance to the goal is known.
+   *
+   *  @param search The search.
    */
-  std::vector<vertex> constructPath(std::map<vertex, vertex> parents, vertex goal);
+  void expand(TIncrementalSearch &search) const;
 };
 
 #endif // GRAPH_H
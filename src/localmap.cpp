@@ -11,8 +11,12 @@
  *  @date 12-10-2017
 */
 #include "localmap.h"
+#include "cellchecker.h"
 
 #include <math.h>
+#include <cstring>
+#include <algorithm>
+#include <limits>
 #include <image_transport/image_transport.h>
 #include <opencv2/highgui/highgui.hpp>
 #include <cv_bridge/cv_bridge.h>
@@ -21,48 +25,100 @@
 static const cv::Scalar PrmColour = cv::Scalar(255,0,0);  /* Blue denotes prm colour */
 static const cv::Scalar PathColour = cv::Scalar(0,0,255); /* Red denotes path colour */
 
-LocalMap::LocalMap(double mapSize, double res): resolution_(res)
+LocalMap::LocalMap(double mapSize, double res): LocalMap(mapSize, mapSize, res)
+{}
+
+LocalMap::LocalMap(double width, double height, double res):
+  resolution_(res), centred_(true), backend_(COLLISION_LINE)
 {
-  pixelMapSize_ = (int) mapSize / res;
+  setMapSize(width, height);
 }
 
 cv::Point LocalMap::convertToPoint(TGlobalOrd reference, TGlobalOrd ordinate){
-  int convertedX;
-  int convertedY;
+  //std::round is symmetric about zero, so the offset carries the sector the
+  //ordinate is within (x grows to the right, y grows upwards in the map)
+  int convertedX = origin_.x + (int)std::round((ordinate.x - reference.x)/resolution_);
+  int convertedY = origin_.y - (int)std::round((ordinate.y - reference.y)/resolution_);
+
+  return cv::Point(convertedX, convertedY);
+}
+
+TGlobalOrd LocalMap::convertToOrd(TGlobalOrd reference, cv::Point point) const{
+  TGlobalOrd ordinate = {reference.x + (point.x - origin_.x) * resolution_,
+                         reference.y - (point.y - origin_.y) * resolution_};
+
+  return ordinate;
+}
+
+void LocalMap::convertToPoints(TGlobalOrd reference, const std::vector<TGlobalOrd> &ordinates,
+                               std::vector<cv::Point> &points){
+  const cv::Point origin = origin_;
+
+  points.resize(ordinates.size());
+  for(size_t i = 0; i < ordinates.size(); i++){
+    points[i].x = origin.x + (int)std::round((ordinates[i].x - reference.x)/resolution_);
+    points[i].y = origin.y - (int)std::round((ordinates[i].y - reference.y)/resolution_);
+  }
+}
+
 
-  //With respect to the reference, determine which sector the ordinate is within
-  if(ordinate.x > reference.x){
-    convertedX = (pixelMapSize_ / 2) + (std::abs(std::round((ordinate.x - reference.x)/resolution_)));
-  } else {
-    convertedX = (pixelMapSize_ / 2) - (std::abs(std::round((ordinate.x - reference.x)/resolution_)));
+cv::Mat LocalMap::fromOccupancyGrid(const int8_t *data, int width, int height,
+                                    int freeThreshold, int occupiedThreshold){
+  //Every occupancy maps to a colour, so look each cell up rather than branching on it
+  uchar colour[256];
+  for(int i = 0; i < 256; i++){
+    int occupancy = (int8_t)i;
+
+    if(occupancy < 0){
+      colour[i] = 127;
+    } else if(occupancy >= occupiedThreshold){
+      colour[i] = 0;
+    } else if(occupancy <= freeThreshold){
+      colour[i] = 255;
+    } else {
+      colour[i] = 127;
+    }
   }
 
-  if(ordinate.y > reference.y){
-    convertedY = (pixelMapSize_ / 2) - (std::abs(std::round((ordinate.y - reference.y)/resolution_)));
-  } else {
-    convertedY = (pixelMapSize_ / 2) + (std::abs(std::round((ordinate.y - reference.y)/resolution_)));
+  cv::Mat cspace(height, width, CV_8UC1);
+  const uchar *cells = reinterpret_cast<const uchar*>(data);
+
+  //The grid's first row is at the bottom of the map, an image's is at the top
+  for(int y = 0; y < height; y++){
+    const uchar *src = cells + (size_t)(height - 1 - y) * width;
+    uchar *dst = cspace.ptr<uchar>(y);
+
+    for(int x = 0; x < width; x++){
+      dst[x] = colour[src[x]];
+    }
   }
 
-  return cv::Point(convertedX, convertedY);
+  return cspace;
 }
 
-
 void LocalMap::expandConfigSpace(cv::Mat &space, cv::Point robotPos, double robotDiameter){
+  //For each point on the map that isn't free space,
+  //expand its boundary by the size of the robot diameter.
+  expandConfigSpace(space, robotPos, robotDiameter, cv::Rect(0, 0, space.cols, space.rows));
+}
+
+void LocalMap::expandConfigSpace(cv::Mat &space, cv::Point robotPos, double robotDiameter, cv::Rect region){
   int pixDiameter = robotDiameter / resolution_;
   std::vector<cv::Point> pointsToExpand;
 
-  //For each point on the map that isn't free space,
-  //expand its boundary by the size of the robot diameter.
-  for(int i = 0; i < space.rows; i++){
-    for(int j = 0; j < space.cols; j++){
-      cv::Point p{i, j};
-
-      if(space.at<uchar>(p) != 255){
-        //Calculate distance between the point and the robot
-        //and check to see if it lies just outside robot' radius's.
-        //see function notes for why this is a problem
-        if(cv::norm(robotPos-p) > ((pixDiameter/2) + 1))
-          pointsToExpand.push_back(p);
+  region &= cv::Rect(0, 0, space.cols, space.rows);
+
+  for(int y = region.y; y < region.y + region.height; y++){
+    const uchar *row = space.ptr<uchar>(y);
+
+    for(int x = region.x; x < region.x + region.width; x++){
+      cv::Point p(x, y);
+
+      //Calculate distance between the point and the robot
+      //and check to see if it lies just outside robot' radius's.
+      //see function notes for why this is a problem
+      if(row[x] != 255 && cv::norm(robotPos-p) > ((pixDiameter/2) + 1)){
+        pointsToExpand.push_back(p);
       }
     }
   }
@@ -71,16 +127,66 @@ void LocalMap::expandConfigSpace(cv::Mat &space, cv::Point robotPos, double robo
   for(auto const &p: pointsToExpand){
     unsigned int inten = space.at<uchar>(p);
 
-    cv::circle(space, p, pixDiameter / 2, (inten, inten, inten), -1);
+    cv::circle(space, p, pixDiameter / 2, cv::Scalar(inten), -1);
   }
 }
 
-double LocalMap::freeConfigSpace(cv::Mat &cspace){
+cv::Rect LocalMap::expandKnownConfigSpace(cv::Mat &space, cv::Point robotPos, double robotDiameter, double margin){
+  int pixMargin = std::max((int)std::round(margin / resolution_),
+                           (int)(robotDiameter / resolution_) / 2 + 1);
+
+  cv::Rect extent = knownExtent(space, pixMargin);
+  expandConfigSpace(space, robotPos, robotDiameter, extent);
+
+  return extent;
+}
+
+cv::Rect LocalMap::knownExtent(const cv::Mat &cspace, int margin) const{
+  int xMin = cspace.cols, xMax = -1;
+  int yMin = cspace.rows, yMax = -1;
+
+  for(int y = 0; y < cspace.rows; y++){
+    const uchar *row = cspace.ptr<uchar>(y);
+
+    //Only the first and last known pixels of a row can widen the extent
+    int first = 0;
+    while(first < cspace.cols && row[first] == 127){
+      first++;
+    }
+
+    if(first == cspace.cols){
+      continue; //Nothing in this row is known
+    }
+
+    int last = cspace.cols - 1;
+    while(row[last] == 127){
+      last--;
+    }
+
+    xMin = std::min(xMin, first);
+    xMax = std::max(xMax, last);
+    yMin = std::min(yMin, y);
+    yMax = y;
+  }
+
+  if(xMax < 0){
+    return cv::Rect();
+  }
+
+  cv::Rect extent(cv::Point(xMin - margin, yMin - margin), cv::Point(xMax + margin + 1, yMax + margin + 1));
+  return extent & cv::Rect(0, 0, cspace.cols, cspace.rows);
+}
+
+double LocalMap::freeConfigSpace(const cv::Mat &cspace, cv::Rect region) const{
   unsigned int freePixels(0);
 
-  for(int i = 0; i < cspace.rows; i++){
-    for(int j = 0; j < cspace.cols; j++){
-      if(cspace.at<uchar>(j,i) == 255){
+  region &= cv::Rect(0, 0, cspace.cols, cspace.rows);
+
+  for(int y = region.y; y < region.y + region.height; y++){
+    const uchar *row = cspace.ptr<uchar>(y);
+
+    for(int x = region.x; x < region.x + region.width; x++){
+      if(row[x] == 255){
         freePixels++;
       }
     }
@@ -91,7 +197,11 @@ double LocalMap::freeConfigSpace(cv::Mat &cspace){
   return freePixels * resolution_ * resolution_ * resolution_;
 }
 
-void LocalMap::overlayPRM(cv::Mat &space, std::vector<std::pair<cv::Point, cv::Point>> prm){
+double LocalMap::freeConfigSpace(cv::Mat &cspace){
+  return freeConfigSpace(cspace, cv::Rect(0, 0, cspace.cols, cspace.rows));
+}
+
+void LocalMap::overlayPRM(cv::Mat &space, const std::vector<std::pair<cv::Point, cv::Point>> &prm){
   for(auto const &neighbours: prm){
     //Draw circles to represent points
     cv::circle(space, neighbours.first, 0.1, PrmColour,-1);
@@ -119,22 +229,238 @@ void LocalMap::overlayPath(cv::Mat &space, std::vector<cv::Point> path){
   }
 }
 
-bool LocalMap::canConnect(cv::Mat &cspace, cv::Point start, cv::Point end){
+bool LocalMap::canConnect(cv::Mat &cspace, cv::Point start, cv::Point end) const{
   //Do a bounds check
   if(!inMap(start) || !inMap(end)){
     return false;
   }
 
-  //Iterate through each pixel between both points, checking that
-  //each pixel is white = free space
-  cv::LineIterator line(cspace, start, end);
-  for(int i = 0; i < line.count; i++, line++){
-    if(!isAccessible(cspace, line.pos())){
-      return false;
+  clip(cspace, start);
+  clip(cspace, end);
+
+  //Check each pixel between both points is white = free space
+  if(backend_ == COLLISION_OFFSETS){
+    return CellChecker<TGreyCells>::canConnectOffsets(cspace, start, end);
+  }
+
+  return CellChecker<TGreyCells>::canConnect(cspace, start, end);
+}
+
+bool LocalMap::canConnect(cv::Mat &cspace, const cv::Mat &costs, cv::Point start, cv::Point end, double &meanCost) const{
+  //Do a bounds check
+  if(!inMap(start) || !inMap(end)){
+    return false;
+  }
+
+  clip(cspace, start);
+  clip(cspace, end);
+
+  //Walked as canConnect() would, so an edge and its weight agree on which pixels are checked
+  if(backend_ == COLLISION_OFFSETS){
+    return CellChecker<TGreyCells>::canConnectOffsets(cspace, costs, start, end, meanCost);
+  }
+
+  return CellChecker<TGreyCells>::canConnect(cspace, costs, start, end, meanCost);
+}
+
+cv::Mat LocalMap::clearanceCost(cv::Mat &cspace, double clearance){
+  cv::Mat freeSpace, distances;
+
+  //Distance (pixels) from each free pixel to the closest non-free pixel
+  cv::compare(cspace, 255, freeSpace, cv::CMP_EQ);
+  cv::distanceTransform(freeSpace, distances, CV_DIST_L2, 3);
+
+  double clearancePixels = std::max(clearance / resolution_, 1.0);
+  cv::Mat costs(distances.rows, distances.cols, CV_32FC1);
+
+  for(int i = 0; i < distances.rows; i++){
+    const float *d = distances.ptr<float>(i);
+    float *c = costs.ptr<float>(i);
+
+    for(int j = 0; j < distances.cols; j++){
+      c[j] = (float)std::max(0.0, 1.0 - d[j] / clearancePixels);
     }
   }
 
-  return true;
+  return costs;
+}
+
+cv::Rect LocalMap::changedRegion(const cv::Mat &before, const cv::Mat &after){
+  if(before.rows != after.rows || before.cols != after.cols || before.type() != after.type()){
+    return cv::Rect(0, 0, after.cols, after.rows);
+  }
+
+  cv::Rect changed;
+  compareShifted(before, after, cv::Point(0, 0), changed);
+  return changed;
+}
+
+std::vector<cv::Rect> LocalMap::changedRegions(const cv::Mat &before, const cv::Mat &after,
+                                               cv::Point shift, int search){
+  cv::Rect whole(0, 0, after.cols, after.rows);
+  if(before.type() != after.type()){
+    return std::vector<cv::Rect>(1, whole);
+  }
+
+  //A misaligned shift differs along every obstacle's border, so the right one differs least
+  cv::Rect changed;
+  cv::Point aligned = shift;
+  size_t fewest = std::numeric_limits<size_t>::max();
+  for(int dy = -search; dy <= search; dy++){
+    for(int dx = -search; dx <= search; dx++){
+      cv::Rect box;
+      size_t differ = compareShifted(before, after, shift + cv::Point(dx, dy), box);
+      if(differ < fewest){
+        fewest = differ;
+        changed = box;
+        aligned = shift + cv::Point(dx, dy);
+      }
+    }
+  }
+
+  cv::Rect overlap = cv::Rect(aligned, before.size()) & whole;
+  if(overlap.area() == 0){
+    return std::vector<cv::Rect>(1, whole);
+  }
+
+  std::vector<cv::Rect> regions;
+  if(changed.area() > 0){
+    regions.push_back(changed);
+  }
+
+  //The strips above and below the overlap, then either side of it
+  const cv::Rect strips[] = {
+    cv::Rect(0, 0, whole.width, overlap.y),
+    cv::Rect(0, overlap.br().y, whole.width, whole.height - overlap.br().y),
+    cv::Rect(0, overlap.y, overlap.x, overlap.height),
+    cv::Rect(overlap.br().x, overlap.y, whole.width - overlap.br().x, overlap.height)
+  };
+
+  for(auto const &strip: strips){
+    if(strip.area() > 0){
+      regions.push_back(strip);
+    }
+  }
+
+  return regions;
+}
+
+size_t LocalMap::compareShifted(const cv::Mat &before, const cv::Mat &after, cv::Point shift, cv::Rect &changed){
+  cv::Rect overlap = cv::Rect(shift, before.size()) & cv::Rect(0, 0, after.cols, after.rows);
+  size_t elemSize = after.elemSize();
+  size_t rowBytes = overlap.width * elemSize;
+  size_t differ = 0;
+  int top = after.rows, bottom = -1;
+  int left = after.cols, right = -1;
+
+  for(int y = overlap.y; y < overlap.y + overlap.height; y++){
+    const uchar *a = before.ptr<uchar>(y - shift.y) + (overlap.x - shift.x) * elemSize;
+    const uchar *b = after.ptr<uchar>(y) + overlap.x * elemSize;
+
+    //Most rows are unchanged, so they're skipped whole
+    if(std::memcmp(a, b, rowBytes) == 0){
+      continue;
+    }
+
+    for(size_t i = 0; i < rowBytes; i++){
+      if(a[i] != b[i]){
+        int x = overlap.x + i / elemSize;
+        left = std::min(left, x);
+        right = std::max(right, x);
+        differ++;
+      }
+    }
+
+    top = std::min(top, y);
+    bottom = y;
+  }
+
+  changed = bottom < 0 ? cv::Rect() : cv::Rect(left, top, right - left + 1, bottom - top + 1);
+  return differ;
+}
+
+cv::Mat LocalMap::skeleton(const cv::Mat &cspace, cv::Rect region) const{
+  cv::Mat skel(cspace.rows, cspace.cols, CV_8UC1, cv::Scalar(0));
+  region &= cv::Rect(0, 0, cspace.cols, cspace.rows);
+
+  //Pixels on the border of the region are left empty, so every
+  //pixel being thinned has all 8 neighbours within the image
+  for(int y = region.y + 1; y < region.y + region.height - 1; y++){
+    const uchar *src = cspace.ptr<uchar>(y);
+    uchar *dst = skel.ptr<uchar>(y);
+
+    for(int x = region.x + 1; x < region.x + region.width - 1; x++){
+      dst[x] = (src[x] == 255) ? 1 : 0;
+    }
+  }
+
+  std::vector<uchar *> marked;
+  bool changed = true;
+
+  while(changed){
+    changed = false;
+
+    for(int pass = 0; pass < 2; pass++){
+      marked.clear();
+
+      for(int y = region.y + 1; y < region.y + region.height - 1; y++){
+        const uchar *above = skel.ptr<uchar>(y - 1);
+        uchar *row = skel.ptr<uchar>(y);
+        const uchar *below = skel.ptr<uchar>(y + 1);
+
+        for(int x = region.x + 1; x < region.x + region.width - 1; x++){
+          if(!row[x]){
+            continue;
+          }
+
+          //Neighbours clockwise from north, p2 to p9
+          uchar p[8] = {above[x], above[x + 1], row[x + 1], below[x + 1],
+                        below[x], below[x - 1], row[x - 1], above[x - 1]};
+
+          int neighbours = 0, transitions = 0;
+          for(int i = 0; i < 8; i++){
+            neighbours += p[i];
+            transitions += (!p[i] && p[(i + 1) % 8]);
+          }
+
+          if(neighbours < 2 || neighbours > 6 || transitions != 1){
+            continue;
+          }
+
+          //The first pass removes south-east boundaries and north-west corners,
+          //the second north-west boundaries and south-east corners
+          bool removable = (pass == 0) ? (!(p[0] && p[2] && p[4]) && !(p[2] && p[4] && p[6]))
+                                       : (!(p[0] && p[2] && p[6]) && !(p[0] && p[4] && p[6]));
+
+          if(removable){
+            marked.push_back(&row[x]);
+          }
+        }
+      }
+
+      for(auto const &pixel: marked){
+        *pixel = 0;
+      }
+
+      changed = changed || !marked.empty();
+    }
+  }
+
+  //1 to 255, for a greyscale image
+  for(int y = region.y; y < region.y + region.height; y++){
+    uchar *row = skel.ptr<uchar>(y);
+
+    for(int x = region.x; x < region.x + region.width; x++){
+      row[x] *= 255;
+    }
+  }
+
+  return skel;
+}
+
+void LocalMap::clip(const cv::Mat &image, cv::Point &p){
+  p.x = std::min(p.x, image.cols - 1);
+  p.y = std::min(p.y, image.rows - 1);
 }
 
 bool LocalMap::isAccessible(cv::Mat &cspace, cv::Point p){
@@ -142,22 +468,48 @@ bool LocalMap::isAccessible(cv::Mat &cspace, cv::Point p){
     return false;
   }
 
-  return (cspace.at<uchar>(p) == 255);
+  return CellChecker<TGreyCells>::isAccessible(cspace, p);
 }
 
-bool LocalMap::inMap(cv::Point p){
-  return (p.y <= pixelMapSize_ && p.y >= 0) && (p.x <= pixelMapSize_ && p.x >= 0);
+bool LocalMap::inMap(cv::Point p) const{
+  return (p.y <= pixelHeight_ && p.y >= 0) && (p.x <= pixelWidth_ && p.x >= 0);
 }
 
 void LocalMap::setMapSize(double mapSize){
-  pixelMapSize_ = (int) mapSize / resolution_;
+  setMapSize(mapSize, mapSize);
+}
+
+void LocalMap::setMapSize(double width, double height){
+  pixelWidth_ = (int)std::round(width / resolution_);
+  pixelHeight_ = (int)std::round(height / resolution_);
+
+  if(centred_){
+    origin_ = cv::Point(pixelWidth_ / 2, pixelHeight_ / 2);
+  }
+}
+
+void LocalMap::setOrigin(cv::Point origin){
+  origin_ = origin;
+  centred_ = false;
+}
+
+void LocalMap::setCollisionBackend(TCollisionBackend backend){
+  backend_ = backend;
 }
 
 void LocalMap::setResolution(double resolution){
   resolution_ = resolution;
 }
 
-double LocalMap::getMapSize() const{
-  return pixelMapSize_ * resolution_;
+double LocalMap::getMapWidth() const{
+  return pixelWidth_ * resolution_;
+}
+
+double LocalMap::getMapHeight() const{
+  return pixelHeight_ * resolution_;
+}
+
+double LocalMap::getResolution() const{
+  return resolution_;
 }
 
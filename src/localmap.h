@@ -16,19 +16,37 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
 #include <utility>
+#include <cstdint>
 
 #include "types.h"
 
+enum TCollisionBackend /*!< How the cspace is walked when checking if two points can connect */
+{
+  COLLISION_LINE,     /*!< Walk the pixel coordinates on the line, see walkLine() */
+  COLLISION_OFFSETS   /*!< Walk offsets into the raw cspace buffer, see walkOffsets() */
+};
+
 class LocalMap
 {
 public:
-  /*! @brief Constructor for LocalMap.
+  /*! @brief Constructor for LocalMap, for square maps.
    *
-   *  @param mapSize The size of the overall map in meters (square maps only).
+   *  @param mapSize The size of the overall map in meters.
    *  @param res The resolution of the local maps provided to this object.
    */
   LocalMap(double mapSize, double res);
 
+  /*! @brief Constructor for LocalMap.
+   *
+   *  @param width The width (x) of the overall map in meters.
+   *  @param height The height (y) of the overall map in meters.
+   *  @param res The resolution of the local maps provided to this object.
+   *
+   *  @note The reference ordinate lies at the centre of the map, unless
+   *        moved with setOrigin().
+   */
+  LocalMap(double width, double height, double res);
+
   /*! @brief Converts a Global coordinate to a pixel coordinate
    *
    *  @param reference The reference position to base our conversion off.
@@ -40,6 +58,28 @@ public:
    */
   cv::Point convertToPoint(TGlobalOrd reference, TGlobalOrd ordinate);
 
+  /*! @brief Converts a pixel coordinate to a Global coordinate.
+   *
+   *  The inverse of convertToPoint(), giving the ordinate at the centre of the pixel.
+   *
+   *  @param reference The reference position to base our conversion off.
+   *  @param point The pixel to convert.
+   *  @return TGlobalOrd The converted ordinate.
+   */
+  TGlobalOrd convertToOrd(TGlobalOrd reference, cv::Point point) const;
+
+  /*! @brief Converts a batch of Global coordinates to pixel coordinates.
+   *
+   *  Equivalent to calling convertToPoint() on each ordinate, without
+   *  branching on the sector each ordinate is in.
+   *
+   *  @param reference The reference position to base our conversion off.
+   *  @param ordinates The coordinates to convert.
+   *  @param points The converted points, in the same order as ordinates.
+   */
+  void convertToPoints(TGlobalOrd reference, const std::vector<TGlobalOrd> &ordinates,
+                       std::vector<cv::Point> &points);
+
   /*! @brief Given a map, determine if two points can be connected.
    *
    *  This method determines if there are any obstacles between start and
@@ -51,8 +91,100 @@ public:
    *  @param end The ending position.
    *  @return bool - TRUE if there is nothing blocking the path between
    *                 start and end.
+   *
+   *  @note For other cspace layouts (e.g. cost maps), see CellChecker.
+   *  @note How the line is walked is chosen with setCollisionBackend().
+   */
+  bool canConnect(cv::Mat &cspace, cv::Point start, cv::Point end) const;
+
+  /*! @brief Given a map, determine if two points can be connected and at what cost.
+   *
+   *  The cost of each pixel is accumulated while checking for obstacles,
+   *  in a single pass along the line.
+   *
+   *  @param cspace The configuration space to look within. Note, this must be a greyscale image!
+   *  @param costs The traversal cost of each pixel (CV_32FC1), see clearanceCost().
+   *  @param start The starting position.
+   *  @param end The ending position.
+   *  @param meanCost Set to the mean cost of the pixels between start and end.
+   *  @return bool - TRUE if there is nothing blocking the path between
+   *                 start and end.
+   *
+   *  @note The line is walked as by canConnect(), see setCollisionBackend().
+   */
+  bool canConnect(cv::Mat &cspace, const cv::Mat &costs, cv::Point start, cv::Point end, double &meanCost) const;
+
+  /*! @brief Creates a cost map that penalises proximity to non-free space.
+   *
+   *  The cost of a pixel is 1 - d / c, where d is its distance (pixels) to the
+   *  nearest obstacle (or unknown space) and c is the clearance in pixels
+   *  (at least 1). A free pixel next to an obstacle (d = 1) so costs 1 - 1 / c,
+   *  falling linearly to 0 at the clearance distance. Non-free pixels cost 1.
+   *
+   *  @param cspace The configuration space. Note, this must be a greyscale image!
+   *  @param clearance The distance (m) from non-free space beyond which there is no cost.
+   *  @return Mat - The cost of each pixel (CV_32FC1), in the range [0, 1].
+   */
+  cv::Mat clearanceCost(cv::Mat &cspace, double clearance);
+
+  /*! @brief Finds the region of a cspace that has changed.
+   *
+   *  @param before The previous configuration space.
+   *  @param after The new configuration space, of the same type.
+   *  @return Rect - The bounding box of the pixels that differ, empty if
+   *                 none do, or the whole of after if the sizes differ.
+   */
+  static cv::Rect changedRegion(const cv::Mat &before, const cv::Mat &after);
+
+  /*! @brief Finds the regions of a cspace that have changed, after it has moved.
+   *
+   *  Only the window where the two overlap is compared, and the pixels of
+   *  after that before doesn't cover are changed. A robot-centred OgMap is cut
+   *  at whole cells around the robot, so shift may be a pixel out. The shifts
+   *  up to search pixels either side of it are tried too, keeping the one
+   *  with the fewest differing pixels.
+   *
+   *  @param before The previous configuration space.
+   *  @param after The new configuration space, of the same type.
+   *  @param shift The pixel of after that pixel (0, 0) of before now lies at.
+   *  @param search How many pixels either side of shift to also try.
+   *  @return vector<Rect> - The bounding box of the pixels that differ (if any), then
+   *                         the strips of after that before didn't cover. The whole
+   *                         of after if the types differ.
+   */
+  static std::vector<cv::Rect> changedRegions(const cv::Mat &before, const cv::Mat &after,
+                                              cv::Point shift, int search);
+
+  /*! @brief Finds the skeleton (medial axis) of the free space within a region.
+   *
+   *  The free space is thinned with the Zhang-Suen algorithm until it is
+   *  one pixel wide, leaving the 8-connected curves furthest from obstacles.
+   *  Each pass visits every pixel of the region, and the amount of passes
+   *  is bounded by half the width of the widest free space.
+   *
+   *  @param cspace The configuration space. Note, this must be a greyscale image!
+   *  @param region The region of the space to thin, see knownExtent().
+   *  @return Mat - The skeleton (CV_8UC1, same size as cspace), where 255 is on the skeleton.
+   */
+  cv::Mat skeleton(const cv::Mat &cspace, cv::Rect region) const;
+
+  /*! @brief Converts the cells of an occupancy grid into a greyscale cspace.
+   *
+   *  Cells with an occupancy at or below freeThreshold become free (white),
+   *  those at or above occupiedThreshold become occupied (black), and all
+   *  others (including unknown cells, -1) become unknown (grey). The grid is
+   *  read directly in a single pass, flipping it so y grows downwards as it
+   *  does in an image.
+   *
+   *  @param data The occupancy of each cell [0, 100], row major from the grid's origin.
+   *  @param width The width of the grid in cells.
+   *  @param height The height of the grid in cells.
+   *  @param freeThreshold The highest occupancy that is free.
+   *  @param occupiedThreshold The lowest occupancy that is occupied.
+   *  @return Mat - The cspace (CV_8UC1), height x width pixels.
    */
-  bool canConnect(cv::Mat &cspace, cv::Point start, cv::Point end);
+  static cv::Mat fromOccupancyGrid(const int8_t *data, int width, int height,
+                                   int freeThreshold, int occupiedThreshold);
 
   /*! @brief Expands the configuration space of a map.
    *
@@ -69,12 +201,48 @@ public:
    */
   void expandConfigSpace(cv::Mat &space, cv::Point robotPos, double robotDiameter);
 
+  /*! @brief Expands the configuration space of a map, only within a region.
+   *
+   *  Only non-free pixels within the region are expanded, although their
+   *  expansion may reach robotDiameter / 2 beyond it.
+   *
+   *  @param space The space (map) to expand.
+   *  @param robotPos The location of the robot in the space (pixel ords)
+   *  @param robotDiameter The diameter of the robot in meters.
+   *  @param region The region of the space to expand, see knownExtent().
+   */
+  void expandConfigSpace(cv::Mat &space, cv::Point robotPos, double robotDiameter, cv::Rect region);
+
+  /*! @brief Expands the configuration space of a map, only within its known extent.
+   *
+   *  Unknown pixels are expanded too, so the margin is grown to at least the
+   *  robot's radius, so those just outside the extent are drawn within it.
+   *
+   *  @param space The space (map) to expand.
+   *  @param robotPos The location of the robot in the space (pixel ords)
+   *  @param robotDiameter The diameter of the robot in meters.
+   *  @param margin The margin (m) around the known pixels to expand.
+   *  @return Rect - The known extent that was expanded, see knownExtent().
+   */
+  cv::Rect expandKnownConfigSpace(cv::Mat &space, cv::Point robotPos, double robotDiameter, double margin);
+
+  /*! @brief Finds the region of a map that has been explored.
+   *
+   *  Akin to HectorMapTools::getMapExtends, this is the bounding box of
+   *  all known (not grey) pixels, grown by a margin and clipped to the map.
+   *
+   *  @param cspace A greyscale image of the configuration space.
+   *  @param margin The amount of pixels to grow the bounding box by.
+   *  @return Rect - The known region, empty if every pixel is unknown.
+   */
+  cv::Rect knownExtent(const cv::Mat &cspace, int margin) const;
+
   /*! @brief Checks if a point is within the known boundaries.
    *
    *  @param p The point to test for its place within the space boundaries.
    *  @return bool - TRUE if it is within the map.
    */
-  bool inMap(cv::Point p);
+  bool inMap(cv::Point p) const;
 
   /*! @brief Checks if a point is within free space.
    *
@@ -93,7 +261,7 @@ public:
    *           is a color enabled image (not greyscale).
    *  @param prm A network of pixel points, and its connection to other points.
    */
-  void overlayPRM(cv::Mat &space, std::vector<std::pair<cv::Point, cv::Point>> prm);
+  void overlayPRM(cv::Mat &space, const std::vector<std::pair<cv::Point, cv::Point>> &prm);
 
   /*! @brief Draws a path onto an existing space.
    *
@@ -107,12 +275,35 @@ public:
    */
   void overlayPath(cv::Mat &space, std::vector<cv::Point> path);
 
-  /*! @brief Setter for updating the map size (square maps only).
+  /*! @brief Setter for updating the map size (square maps).
    *
    *  @param mapSize The size of the overall map in meters.
    */
   void setMapSize(double mapSize);
 
+  /*! @brief Setter for updating the map size.
+   *
+   *  @param width The width (x) of the overall map in meters.
+   *  @param height The height (y) of the overall map in meters.
+   */
+  void setMapSize(double width, double height);
+
+  /*! @brief Setter for the pixel the reference ordinate lies at.
+   *
+   *  By default the reference is at the centre of the map, and stays there
+   *  as the map size changes. Once set, the origin is fixed, e.g. at the
+   *  bottom left pixel for a reference at the corner of the map.
+   *
+   *  @param origin The pixel of the reference ordinate.
+   */
+  void setOrigin(cv::Point origin);
+
+  /*! @brief Selects how the cspace is walked by canConnect().
+   *
+   *  @param backend The collision backend to use, COLLISION_LINE by default.
+   */
+  void setCollisionBackend(TCollisionBackend backend);
+
   /*! @brief Setter for updating map resolution.
    *
    *  @param resolution The resolution of the local maps provided to this object.
@@ -129,15 +320,59 @@ public:
    */
   double freeConfigSpace(cv::Mat &cspace);
 
-  /*! @brief Gets the size of the map
+  /*! @brief Meaures the volume of the free configuration space within a region.
+   *
+   *  @param cspace The configuration space to measure.
+   *  @param region The region to measure, free space outside it is not counted.
+   *  @return double The measured volume.
+   */
+  double freeConfigSpace(const cv::Mat &cspace, cv::Rect region) const;
+
+  /*! @brief Gets the width of the map
+   *
+   *  @return double - The map width (x) in meters.
+   */
+  double getMapWidth() const;
+
+  /*! @brief Gets the height of the map
+   *
+   *  @return double - The map height (y) in meters.
+   */
+  double getMapHeight() const;
+
+  /*! @brief Gets the resolution of the map
    *
-   *  @return double - The map size in meters.
+   *  @return double - The size of each pixel in meters.
    */
-  double getMapSize() const;
+  double getResolution() const;
 
 private:
   double resolution_;         /*!< Will specify the amount of pixels per meter */
-  unsigned int pixelMapSize_; /*!< The total mapSize (square maps/images only) in pixels */
+  int pixelWidth_;            /*!< The width of the map in pixels */
+  int pixelHeight_;           /*!< The height of the map in pixels */
+  cv::Point origin_;          /*!< The pixel the reference ordinate lies at */
+  bool centred_;              /*!< TRUE if origin_ follows the centre of the map */
+  TCollisionBackend backend_; /*!< How the cspace is walked by canConnect() */
+
+  /*! @brief Clips a point to within an image.
+   *
+   *  inMap() includes the far edge of the map, so points on that edge are
+   *  clipped to the image as cv::LineIterator would.
+   *
+   *  @param image The image to clip to.
+   *  @param p The point to clip.
+   */
+  static void clip(const cv::Mat &image, cv::Point &p);
+
+  /*! @brief Compares the window where two shifted images overlap.
+   *
+   *  @param before The previous image.
+   *  @param after The new image, of the same type.
+   *  @param shift The pixel of after that pixel (0, 0) of before lies at.
+   *  @param changed Set to the bounding box (in after) of the pixels that differ, empty if none do.
+   *  @return size_t - The amount of bytes that differ.
+   */
+  static size_t compareShifted(const cv::Mat &before, const cv::Mat &after, cv::Point shift, cv::Rect &changed);
 
 };
 
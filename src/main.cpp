@@ -14,9 +14,28 @@
  *  be specified.
  *
  *  - _map_size:=[size of supplied ogMap in meters]
+ *  - _map_width:=[width of supplied ogMap in meters, if not square]
+ *  - _map_height:=[height of supplied ogMap in meters, if not square]
  *  - _resolution:=[resolution of the opencv map image]
  *  - _density:=[max density the prm network can have]
  *  - _robot_diameter:=the diameter of the robot in meters]
+ *  - _overlay_rate:=[max rate in Hz the /prm overlay is published at]
+ *  - _overlay_scale:=[scale (0, 1] of the /prm overlay, to reduce bandwidth]
+ *  - _clearance:=[distance in meters from obstacles to penalise, 0 to disable]
+ *  - _clearance_weight:=[penalty for travelling close to obstacles]
+ *  - _dynamic_radius:=[radius (m) of each obstacle on /dynamic_obstacles]
+ *  - _dynamic_lifetime:=[max time (s) each obstacle on /dynamic_obstacles blocks the network, if no newer message replaces it]
+ *  - _monitor_path:=[true to check the last path against new OgMaps and obstacles, repairing it locally]
+ *  - _replan:=[true to drop edges blocked by new OgMaps, and repair the last search for each goal]
+ *  - _skeleton:=[true to add the skeleton (medial axis) of each new occupancy grid to the network]
+ *  - _sampling:=[uniform, gaussian (near obstacles) or bridge (in narrow gaps)]
+ *  - _connection:=[fixed (density neighbours), prm_star (log(n) neighbours) or visibility (guards and connectors only)]
+ *  - _prebuild_nodes:=[size of the network to build before any goal arrives, 0 to disable]
+ *  - _hierarchy:=[true to query a contraction hierarchy of the network, built once it is prebuilt]
+ *  - _roadmap_file:=[file the network is loaded from on startup, and saved to with its hierarchy]
+ *  - _occupancy_grid:=[true to read the OgMap from /map rather than /map_image/full]
+ *  - _free_threshold:=[highest occupancy in the grid that is free space]
+ *  - _occupied_threshold:=[lowest occupancy in the grid that is occupied space]
  *
  *  @author arosspope
  *  @date 23-10-2017
@@ -40,6 +59,7 @@ int main(int argc, char **argv) {
   std::shared_ptr<WorldRetrieve> wr(new WorldRetrieve(nh, buffer));
   std::shared_ptr<Simulator> sim(new Simulator(nh, buffer));
 
+  threads.push_back(std::thread(&Simulator::cspaceThread, sim));
   threads.push_back(std::thread(&Simulator::plannerThread, sim));
   threads.push_back(std::thread(&Simulator::overlayThread, sim));
 
@@ -0,0 +1,73 @@
+/*! @file
+ *
+ *  @brief Nodelet versions of the prm_sim nodes.
+ *
+ *  Loading these nodelets into the same manager passes OgMaps between the
+ *  image provider and the planner as shared pointers, rather than
+ *  serialising each map and sending it over the loopback interface.
+ *
+ *  - prm_sim/MapToImage is the equivalent of prm_sim_image_node.
+ *  - prm_sim/Planner is the equivalent of prm_sim_node.
+ *
+ *  @author agent
+ *  @date 17-10-2026
+*/
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "map_to_image.h"
+#include "simulator.h"
+#include "worldretrieve.h"
+#include "types.h"
+
+namespace prm_sim
+{
+
+class MapToImage : public nodelet::Nodelet
+{
+private:
+  std::shared_ptr<MapAsImageProvider> provider_; /*!< Converts occupancy grids to images */
+
+  virtual void onInit(){
+    provider_.reset(new MapAsImageProvider(getNodeHandle(), getPrivateNodeHandle()));
+  }
+};
+
+class Planner : public nodelet::Nodelet
+{
+public:
+  ~Planner(){
+    if(sim_){
+      sim_->stop();
+    }
+
+    for(auto &t: threads_){
+      t.join();
+    }
+  }
+
+private:
+  TWorldDataBuffer buffer_;             /*!< Populated by wr_, and consumed by sim_ */
+  std::shared_ptr<WorldRetrieve> wr_;   /*!< Subscribes to the robot's pose and OgMap */
+  std::shared_ptr<Simulator> sim_;      /*!< Builds the prm and plans paths */
+  std::vector<std::thread> threads_;    /*!< The cspace, planner and overlay threads of sim_ */
+
+  virtual void onInit(){
+    //onInit must not block, so the simulator's loops get threads of their own
+    wr_.reset(new WorldRetrieve(getNodeHandle(), getPrivateNodeHandle(), buffer_));
+    sim_.reset(new Simulator(getNodeHandle(), getPrivateNodeHandle(), buffer_));
+
+    threads_.push_back(std::thread(&Simulator::cspaceThread, sim_));
+    threads_.push_back(std::thread(&Simulator::plannerThread, sim_));
+    threads_.push_back(std::thread(&Simulator::overlayThread, sim_));
+  }
+};
+
+} // namespace prm_sim
+
+PLUGINLIB_EXPORT_CLASS(prm_sim::MapToImage, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(prm_sim::Planner, nodelet::Nodelet)
@@ -18,9 +18,15 @@
 #include "prmplanner.h"
 
 #include <math.h>
+#include <fstream>
+#include <iomanip>
 #include <random>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <limits>
+#include <tuple>
+#include <iterator>
 
 PrmPlanner::PrmPlanner():
   graph_(Graph(PLANNER_DEF_DENSITY)), lmap_(LocalMap(PLANNER_DEF_MAP_SIZE, PLANNER_DEF_MAP_RES))
@@ -29,15 +35,37 @@ PrmPlanner::PrmPlanner():
   reference_.x = 0;
   reference_.y = 0;
   density_ = PLANNER_DEF_DENSITY;
+  costWeight_ = 0;
+  connection_ = CONNECT_FIXED_K;
+  sampling_ = SAMPLE_UNIFORM;
+  joined_ = 0;
+  edgeChecks_ = 0;
+  blockedStale_ = false;
+  hierarchyCurrent_ = false;
+  queryMethod_ = QUERY_DIJKSTRA;
+  networkVersion_ = 0;
 }
 
 PrmPlanner::PrmPlanner(double mapSize, double mapRes, unsigned int density):
-  graph_(Graph(density)), lmap_(LocalMap(mapSize, mapRes))
+  PrmPlanner(mapSize, mapSize, mapRes, density)
+{}
+
+PrmPlanner::PrmPlanner(double mapWidth, double mapHeight, double mapRes, unsigned int density):
+  graph_(Graph(density)), lmap_(LocalMap(mapWidth, mapHeight, mapRes))
 {
   nextVertexId_ = 0;
   reference_.x = 0;
   reference_.y = 0;
   density_ = density;
+  costWeight_ = 0;
+  connection_ = CONNECT_FIXED_K;
+  sampling_ = SAMPLE_UNIFORM;
+  joined_ = 0;
+  edgeChecks_ = 0;
+  blockedStale_ = false;
+  hierarchyCurrent_ = false;
+  queryMethod_ = QUERY_DIJKSTRA;
+  networkVersion_ = 0;
 }
 
 std::vector<TGlobalOrd> PrmPlanner::build(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal)
@@ -65,67 +93,843 @@ std::vector<TGlobalOrd> PrmPlanner::build(cv::Mat &cspace, TGlobalOrd start, TGl
   embedNode(cspace, vStart, 1, true);
   embedNode(cspace, vGoal, 1, true);
 
+  //Connectors only join guards, so a start or goal that sees nothing must guard itself
+  if(connection_ == CONNECT_VISIBILITY){
+    for(auto const &v: {vStart, vGoal}){
+      if(graph_.getEdgeCount(v) == 0 && std::find(guards_.begin(), guards_.end(), v) == guards_.end()){
+        guards_.push_back(v);
+      }
+    }
+  }
+
+  //A dense network (e.g. one built ahead of the goal) may already join them
+  path = query(cspace, start, goal);
+  if(path.size() > 0){
+    return path;
+  }
+
+  //Build 200 nodes at a time, and strengthen the network by joining it
+  //with the new nodes
+  sampleNodes(cspace, PLANNER_BUILD_NODES);
+  joinNetwork(cspace, density_);
+
+  return query(cspace, start, goal);
+}
+
+unsigned int PrmPlanner::densify(cv::Mat &cspace, unsigned int nodes){
+  unsigned int added = sampleNodes(cspace, nodes);
+
+  //Joining the whole network each batch would make later batches ever slower
+  if(added > 0 && connection_ == CONNECT_FIXED_K){
+    joinNewNodes(cspace, density_);
+  } else if(added > 0){
+    joinNetwork(cspace, density_);
+  }
+
+  return added;
+}
+
+unsigned int PrmPlanner::buildSkeleton(cv::Mat &cspace){
+  return buildSkeleton(cspace, lmap_.skeleton(cspace, samplingRegion(cspace)));
+}
+
+unsigned int PrmPlanner::buildSkeleton(cv::Mat &cspace, const cv::Mat &skeleton){
+  static const cv::Point around[8] = {{0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}};
+
+  unsigned int before = network_.size();
+  int cols = skeleton.cols;
+  double spacing = PLANNER_SKELETON_SPACING / lmap_.getResolution();
+
+  std::vector<int> nodes(skeleton.rows * cols, -1);         //The vertex placed at each pixel, -1 if none
+  std::vector<bool> visited(skeleton.rows * cols, false);   //Pixels already walked
+
+  auto index = [cols](cv::Point p){ return p.y * cols + p.x; };
+  auto on = [&](cv::Point p){
+    return p.x >= 0 && p.y >= 0 && p.x < cols && p.y < skeleton.rows && skeleton.ptr<uchar>(p.y)[p.x] == 255;
+  };
+  auto degree = [&](cv::Point p){
+    int n = 0;
+    for(auto const &d: around){
+      n += on(p + d);
+    }
+    return n;
+  };
+  auto node = [&](cv::Point p){
+    int &v = nodes[index(p)];
+    if(v < 0){
+      v = findOrAdd(lmap_.convertToOrd(reference_, p));
+    }
+    return (vertex)v;
+  };
+  auto link = [&](vertex v, vertex u){
+    weight w;
+    if(v == u || graph_.hasEdge(v, u)){
+      return true;
+    }
+
+    edgeChecks_++;
+    return edgeWeight(cspace, v, u, w) && connect(v, u, w);
+  };
+
+  //Walks a branch from a node until it reaches another, placing nodes
+  //wherever the straight edge from the last would leave the free space
+  auto walk = [&](vertex anchor, cv::Point prev, cv::Point cur){
+    cv::Point anchorPixel = pixel(anchor);
+
+    while(true){
+      int i = index(cur);
+      if(nodes[i] >= 0){
+        if(!link(anchor, nodes[i]) && nodes[index(prev)] < 0){
+          vertex v = node(prev);
+          link(anchor, v);
+          link(v, nodes[i]);
+        }
+        return;
+      }
+
+      if(visited[i]){
+        return; //Joined a branch already walked
+      }
+      visited[i] = true;
+
+      edgeChecks_++;
+      if(cv::norm(cur - anchorPixel) > spacing || !lmap_.canConnect(cspace, anchorPixel, cur)){
+        vertex v = node(prev);
+        link(anchor, v);
+        anchor = v;
+        anchorPixel = pixel(v);
+      }
+
+      //Carry on along the skeleton, stopping at a node if one is next to us
+      cv::Point next(-1, -1);
+      for(auto const &d: around){
+        cv::Point q = cur + d;
+        if(q == prev || !on(q)){
+          continue;
+        }
+
+        if(nodes[index(q)] >= 0 && (vertex)nodes[index(q)] != anchor){
+          next = q;
+          break;
+        }
+
+        if(!visited[index(q)] && next.x < 0){
+          next = q;
+        }
+      }
+
+      if(next.x < 0){
+        link(anchor, node(cur));
+        return;
+      }
+
+      prev = cur;
+      cur = next;
+    }
+  };
+
+  //Place a node at each end and junction, a junction several pixels wide shares one
+  std::vector<cv::Point> keys;
+  for(int y = 0; y < skeleton.rows; y++){
+    for(int x = 0; x < cols; x++){
+      cv::Point p(x, y);
+      if(on(p) && degree(p) != 2){
+        keys.push_back(p);
+      }
+    }
+  }
+
+  for(auto const &key: keys){
+    if(nodes[index(key)] >= 0){
+      continue;
+    }
+
+    vertex v = node(key);
+    std::vector<cv::Point> cluster(1, key);
+    visited[index(key)] = true;
+
+    while(!cluster.empty()){
+      cv::Point p = cluster.back();
+      cluster.pop_back();
+
+      for(auto const &d: around){
+        cv::Point q = p + d;
+        if(on(q) && !visited[index(q)] && degree(q) != 2){
+          nodes[index(q)] = v;
+          visited[index(q)] = true;
+          cluster.push_back(q);
+        }
+      }
+    }
+  }
+
+  //Walk every branch leaving a node
+  for(auto const &key: keys){
+    for(auto const &d: around){
+      cv::Point q = key + d;
+      if(on(q) && (!visited[index(q)] || nodes[index(q)] >= 0)){
+        walk(nodes[index(key)], key, q);
+      }
+    }
+  }
+
+  //Any loops left have no ends or junctions to start from
+  for(int y = 0; y < skeleton.rows; y++){
+    for(int x = 0; x < cols; x++){
+      cv::Point p(x, y);
+      if(!on(p) || visited[index(p)]){
+        continue;
+      }
+
+      visited[index(p)] = true;
+      for(auto const &d: around){
+        if(on(p + d) && !visited[index(p + d)]){
+          walk(node(p), p, p + d);
+          break;
+        }
+      }
+    }
+  }
+
+  return network_.size() - before;
+}
+
+unsigned int PrmPlanner::nodeCount() const{
+  return network_.size();
+}
+
+unsigned int PrmPlanner::sampleNodes(cv::Mat &cspace, unsigned int nodes){
+  //Only the known part of the map is measured and sampled, early in
+  //exploration most of the map is unknown and can't hold any nodes
+  cv::Rect region = samplingRegion(cspace);
+  TGlobalOrd topLeft = lmap_.convertToOrd(reference_, region.tl());
+  TGlobalOrd bottomRight = lmap_.convertToOrd(reference_, region.br());
+
   //Calculate seperation radius
-  unsigned int numNodes = network_.size() + 200;
-  double freeSpace = lmap_.freeConfigSpace(cspace);
+  unsigned int numNodes = network_.size() + nodes;
+  double freeSpace = lmap_.freeConfigSpace(cspace, region);
   double r = (1.0/(double)numNodes)*std::sqrt((freeSpace*(numNodes - std::pow(numNodes, 0.5)))/M_PI);
 
-  //Build 200 nodes at a time
-  while(network_.size() < numNodes){
+  //Generate random ords within the map space...
+  std::default_random_engine generator(std::chrono::duration_cast<std::chrono::nanoseconds>
+                                       (std::chrono::system_clock::now().time_since_epoch()).count());
+  std::uniform_real_distribution<double> xDist(topLeft.x, bottomRight.x);
+  std::uniform_real_distribution<double> yDist(bottomRight.y, topLeft.y);
+  std::uniform_real_distribution<double> share(0.0, 1.0);
+
+  //A map with little (or no) free space could otherwise be sampled forever
+  unsigned int attempts = nodes * PLANNER_MAX_SAMPLE_ATTEMPTS;
+  unsigned int added = 0;
+  unsigned int rejects = 0;
+
+  while(network_.size() < numNodes && attempts > 0){
     TGlobalOrd randomOrd;
-    //Generate random ords within the map space...
-    std::default_random_engine generator(std::chrono::duration_cast<std::chrono::nanoseconds>
-                                         (std::chrono::system_clock::now().time_since_epoch()).count());
+    attempts--;
 
-    double mapSize = lmap_.getMapSize();
-    std::uniform_real_distribution<double> xDist(reference_.x - (mapSize/2), reference_.x + (mapSize/2));
-    std::uniform_real_distribution<double> yDist(reference_.y - (mapSize/2), reference_.y + (mapSize/2));
+    randomOrd.x = xDist(generator);
+    randomOrd.y = yDist(generator);
+
+    if(sampling_ != SAMPLE_UNIFORM && share(generator) >= PLANNER_UNIFORM_SHARE){
+      if(!biasSample(cspace, generator, randomOrd)){
+        continue; //Not near an obstacle or in a gap, skip
+      }
+    }
 
     //round to 1 decimal place
-    randomOrd.x = std::round((xDist(generator) * 10.0))/10.0;
-    randomOrd.y = std::round((yDist(generator) * 10.0))/10.0;
+    randomOrd.x = std::round(randomOrd.x * 10.0)/10.0;
+    randomOrd.y = std::round(randomOrd.y * 10.0)/10.0;
 
     if(existsAsVertex(randomOrd)){
       continue; //Already exists in graph, skip
     }
 
-    if(!lmap_.isAccessible(cspace, lmap_.convertToPoint(reference_, randomOrd))){
-      continue; //Is not accessible in the ogmap, skip
+    if(!lmap_.isAccessible(cspace, lmap_.convertToPoint(reference_, randomOrd))){
+      continue; //Is not accessible in the ogmap, skip
+    }
+
+    if(connection_ == CONNECT_VISIBILITY){
+      //Visibility decides what is kept, rather than seperation
+      if(addVisibleNode(cspace, randomOrd)){
+        added++;
+        rejects = 0;
+      } else if(++rejects >= PLANNER_VISIBILITY_MAX_REJECTS){
+        break; //The free space is (very likely) covered by the guards
+      }
+
+      continue;
+    }
+
+    if(violatingSpace(randomOrd, r)){
+      continue; //We want uniform distribution, skip
+    }
+
+    //Its passed all checks, add the ordinate to the graph!
+    addOrdinate(randomOrd);
+    added++;
+  }
+
+  return added;
+}
+
+std::vector<TGlobalOrd> PrmPlanner::query(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal){
+  std::vector<TGlobalOrd> path;
+
+  refreshBlocked();
+  query(cspace, start, goal, workspace_, path);
+  return path;
+}
+
+std::vector<std::vector<TGlobalOrd>> PrmPlanner::query(cv::Mat &cspace,
+                                                       const std::vector<std::pair<TGlobalOrd, TGlobalOrd>> &pairs,
+                                                       unsigned int threads){
+  std::vector<std::vector<TGlobalOrd>> paths;
+  query(cspace, pairs, paths, threads);
+  return paths;
+}
+
+void PrmPlanner::query(cv::Mat &cspace, const std::vector<std::pair<TGlobalOrd, TGlobalOrd>> &pairs,
+                       std::vector<std::vector<TGlobalOrd>> &paths, unsigned int threads){
+  paths.resize(pairs.size());
+
+  //The workers (and their workspaces) are kept between batches
+  if(!pool_ || (threads != 0 && pool_->size() != threads)){
+    pool_ = std::make_shared<WorkPool>(threads);
+  }
+  workspaces_.resize(pool_->size());
+  refreshBlocked();
+
+  pool_->run(pairs.size(), [&](size_t task, unsigned int worker){
+    query(cspace, pairs[task].first, pairs[task].second, workspaces_[worker], paths[task]);
+  });
+}
+
+void PrmPlanner::query(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal,
+                       TQueryWorkspace &workspace, std::vector<TGlobalOrd> &path) const{
+  vertex vStart, vGoal;
+
+  path.clear();
+  if(!lookup(start, vStart) || !lookup(goal, vGoal)){
+    return;
+  }
+
+  //The hierarchy has no way to leave out blocked edges, so the whole network is searched instead
+  if(queryMethod_ == QUERY_HIERARCHY && hierarchyCurrent_ && blocked_.empty() &&
+     hierarchy_.contains(vStart) && hierarchy_.contains(vGoal)){
+    hierarchy_.shortestPath(vStart, vGoal, workspace.forward, workspace.backward, workspace.path);
+  } else {
+    graph_.shortestPath(vStart, vGoal, workspace.forward, &blocked_, workspace.path);
+  }
+
+  if(workspace.path.size() > 0){
+    optimisePath(cspace, workspace.path, workspace.pathWeight, path);
+  }
+}
+
+std::vector<TGlobalOrd> PrmPlanner::replan(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal){
+  if(!ordinateAccessible(cspace, start) || !ordinateAccessible(cspace, goal)){
+    return std::vector<TGlobalOrd>();
+  }
+
+  //Only new ends are joined, so repeated replans don't keep adding edges to them
+  vertex vStart = findOrAdd(start);
+  vertex vGoal = findOrAdd(goal);
+  for(auto const &v: {vStart, vGoal}){
+    if(graph_.getEdgeCount(v) == 0){
+      embedNode(cspace, v, 1, true);
+    }
+  }
+
+  //Edges are never shorter than the straight line between their ends
+  search_.heuristic = [this](vertex v, vertex u){ return distance(network_.at(v), network_.at(u)); };
+  search_.blocked = &blocked_;
+  refreshBlocked();
+
+  std::vector<vertex> vPath = graph_.shortestPath(vStart, vGoal, search_);
+  if(vPath.size() > 0){
+    return optimisePath(cspace, vPath);
+  }
+
+  return std::vector<TGlobalOrd>();
+}
+
+TPathStatus PrmPlanner::checkPath(cv::Mat &cspace, std::vector<TGlobalOrd> &path){
+  bool repaired = false;
+  cv::Rect bounds(0, 0, cspace.cols, cspace.rows);
+
+  refreshBlocked();
+
+  for(unsigned int i = 0; i + 1 < path.size(); i++){
+    if(segmentFree(cspace, path[i], path[i + 1])){
+      continue;
+    }
+
+    //The path up to path[i] is free, so rejoin it at the next waypoint that isn't
+    //within an obstacle (or is beyond cspace). A transient obstacle over the goal
+    //may move on, so it is only skipped for the waypoints before it
+    auto rejoinable = [&](unsigned int j){
+      cv::Point p = lmap_.convertToPoint(reference_, path[j]);
+      if(bounds.contains(p) && !lmap_.isAccessible(cspace, p)){
+        return false;
+      }
+      return j + 1 == path.size() || !crossesObstacle(path[j], path[j]);
+    };
+
+    unsigned int j = i + 1;
+    while(j < path.size() && !rejoinable(j)){
+      j++;
+    }
+
+    if(j == path.size()){
+      return PATH_BLOCKED; //The goal itself is blocked
+    }
+
+    updateEdges(cspace, regionAround(path[i], path[j], PLANNER_REPAIR_MARGIN));
+
+    std::vector<TGlobalOrd> around = detour(cspace, path[i], path[j]);
+    if(around.empty()){
+      return PATH_BLOCKED;
+    }
+
+    //Splice the detour in place of the blocked waypoints, then carry on from path[j]
+    path.erase(path.begin() + i + 1, path.begin() + j);
+    path.insert(path.begin() + i + 1, around.begin() + 1, around.end() - 1);
+    i += around.size() - 2;
+    repaired = true;
+  }
+
+  return repaired ? PATH_REPAIRED : PATH_VALID;
+}
+
+bool PrmPlanner::segmentFree(cv::Mat &cspace, TGlobalOrd o1, TGlobalOrd o2){
+  cv::Rect bounds(0, 0, cspace.cols, cspace.rows);
+  cv::Point p1 = lmap_.convertToPoint(reference_, o1);
+  cv::Point p2 = lmap_.convertToPoint(reference_, o2);
+
+  if(!bounds.contains(p1) || !bounds.contains(p2)){
+    return true; //Not known, it will be checked when it comes into view
+  }
+
+  return lmap_.canConnect(cspace, p1, p2) && !crossesObstacle(o1, o2);
+}
+
+std::vector<TGlobalOrd> PrmPlanner::detour(cv::Mat &cspace, TGlobalOrd from, TGlobalOrd to){
+  refreshBlocked();
+
+  //Waypoints that aren't nodes (such as the robot's position) aren't added, which
+  //would grow the network and the roadmap, and make the hierarchy stale
+  vertex vFrom, vTo;
+  if(!nearestNode(cspace, from, vFrom) || !nearestNode(cspace, to, vTo)){
+    return std::vector<TGlobalOrd>();
+  }
+
+  //Both ends see the same node (e.g. the robot can see path[j]), which a search
+  //would report as unreachable. Go through it, unless the ends see each other
+  if(vFrom == vTo){
+    std::vector<TGlobalOrd> around{from};
+    if(!segmentFree(cspace, from, to)){
+      around.push_back(network_.at(vFrom));
+    }
+    around.push_back(to);
+
+    return around;
+  }
+
+  //The search stops at the goal, so only the network near a short detour is visited.
+  //Edges it uses that turn out to be blocked are dropped (with their surroundings)
+  //and the search made again.
+  for(unsigned int attempt = 0; attempt < PLANNER_REPAIR_ATTEMPTS; attempt++){
+    std::vector<vertex> vPath = graph_.shortestPath(vFrom, vTo, workspace_.forward, &blocked_);
+    if(vPath.empty()){
+      return std::vector<TGlobalOrd>();
+    }
+
+    unsigned int i = 1;
+    while(i < vPath.size() && segmentFree(cspace, network_.at(vPath[i - 1]), network_.at(vPath[i]))){
+      i++;
+    }
+
+    if(i == vPath.size()){
+      std::vector<TGlobalOrd> around = optimisePath(cspace, vPath);
+      if(!(network_.at(vFrom) == from)){
+        around.insert(around.begin(), from);
+      }
+      if(!(network_.at(vTo) == to)){
+        around.push_back(to);
+      }
+
+      return around;
+    }
+
+    updateEdges(cspace, regionAround(network_.at(vPath[i - 1]), network_.at(vPath[i]), PLANNER_REPAIR_MARGIN));
+  }
+
+  return std::vector<TGlobalOrd>();
+}
+
+bool PrmPlanner::nearestNode(cv::Mat &cspace, TGlobalOrd ord, vertex &v){
+  if(lookup(ord, v)){
+    return true;
+  }
+
+  std::vector<std::pair<double, vertex>> candidates;
+  for(auto const &node: network_){
+    if(graph_.getEdgeCount(node.first) > 0){
+      candidates.push_back(std::make_pair(distance(ord, node.second), node.first));
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  for(auto const &candidate: candidates){
+    if(segmentFree(cspace, ord, network_.at(candidate.second))){
+      v = candidate.second;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+cv::Rect PrmPlanner::regionAround(TGlobalOrd o1, TGlobalOrd o2, double margin){
+  cv::Point p1 = lmap_.convertToPoint(reference_, o1);
+  cv::Point p2 = lmap_.convertToPoint(reference_, o2);
+  int pixels = std::ceil(margin / lmap_.getResolution());
+
+  return cv::Rect(cv::Point(std::min(p1.x, p2.x) - pixels, std::min(p1.y, p2.y) - pixels),
+                  cv::Point(std::max(p1.x, p2.x) + pixels + 1, std::max(p1.y, p2.y) + pixels + 1));
+}
+
+unsigned int PrmPlanner::updateEdges(cv::Mat &cspace, cv::Rect region){
+  return updateEdges(cspace, std::vector<cv::Rect>(1, region));
+}
+
+unsigned int PrmPlanner::updateEdges(cv::Mat &cspace, const std::vector<cv::Rect> &regions){
+  std::vector<std::pair<vertex, vertex>> blocked;
+  std::vector<std::tuple<vertex, vertex, weight>> reweighted;
+  edgeSet candidates;
+
+  cv::Rect bounds(0, 0, cspace.cols, cspace.rows);
+  for(cv::Rect region: regions){
+    region &= bounds;
+    if(region.area() > 0){
+      edgesWithin(region, candidates);
+    }
+  }
+
+  //Collect the changes first, as the graph can't be changed while it is walked
+  for(auto const &e: candidates){
+    if(!bounds.contains(pixel(e.first)) || !bounds.contains(pixel(e.second))){
+      continue; //Not known, it will be checked when it comes into view
+    }
+
+    weight w;
+    edgeChecks_++;
+    if(!edgeWeight(cspace, e.first, e.second, w)){
+      blocked.push_back(e);
+    } else if(w != graph_.getWeight(e.first, e.second)){
+      reweighted.push_back(std::make_tuple(e.first, e.second, w));
+    }
+  }
+
+  for(auto const &e: blocked){
+    graph_.removeEdge(e.first, e.second);
+    indexEdge(e.first, e.second, false);
+    trackRemovedEdge(e.first, e.second);
+    graph_.repairEdge(e.first, e.second, search_);
+  }
+
+  for(auto const &e: reweighted){
+    graph_.setWeight(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+    graph_.repairEdge(std::get<0>(e), std::get<1>(e), search_);
+  }
+
+  //The components only ever merge, so a removed edge may have split one
+  if(blocked.size() > 0){
+    rebuildComponents();
+  }
+
+  if(blocked.size() > 0 || reweighted.size() > 0){
+    hierarchyCurrent_ = false;
+    networkVersion_++;
+  }
+
+  return blocked.size();
+}
+
+void PrmPlanner::addDynamicObstacle(TGlobalOrd centre, double radius, double lifetime){
+  auto expiry = std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(lifetime));
+
+  obstacles_.push_back(TDynamicObstacle{centre, radius, expiry});
+  blockedStale_ = true;
+}
+
+void PrmPlanner::clearDynamicObstacles(){
+  if(!obstacles_.empty()){
+    obstacles_.clear();
+    blockedStale_ = true;
+  }
+}
+
+unsigned int PrmPlanner::blockedEdgeCount() const{
+  return blocked_.size();
+}
+
+void PrmPlanner::refreshBlocked(){
+  auto now = std::chrono::steady_clock::now();
+  auto expired = std::remove_if(obstacles_.begin(), obstacles_.end(),
+                                [now](const TDynamicObstacle &o){ return o.expiry <= now; });
+
+  if(expired != obstacles_.end()){
+    obstacles_.erase(expired, obstacles_.end());
+    blockedStale_ = true;
+  }
+
+  if(!blockedStale_){
+    return;
+  }
+
+  //An edge is never longer than its weight, so one can only reach an obstacle
+  //if its first vertex is within the edge's weight of it
+  auto reaches = [this](TGlobalOrd ord, weight w){
+    for(auto const &o: obstacles_){
+      if(distance(ord, o.centre) <= o.radius + w){
+        return true;
+      }
+    }
+    return false;
+  };
+
+  //Only the edges are tested against the obstacles, the cspace isn't touched
+  edgeSet blocked;
+  if(!obstacles_.empty()){
+    for(auto const &node: graph_.container()){
+      TGlobalOrd ord = network_.at(node.first);
+
+      for(auto const &e: node.second){
+        if(e.first > node.first && reaches(ord, e.second) && crossesObstacle(ord, network_.at(e.first))){
+          blocked.insert(std::make_pair(node.first, e.first));
+        }
+      }
+    }
+  }
+
+  //Only edges that were blocked or unblocked affect the distances in the last replan()
+  std::vector<std::pair<vertex, vertex>> changed;
+  std::set_symmetric_difference(blocked.begin(), blocked.end(), blocked_.begin(), blocked_.end(),
+                                std::back_inserter(changed));
+
+  blocked_.swap(blocked);
+  blockedStale_ = false;
+
+  for(auto const &e: changed){
+    graph_.repairEdge(e.first, e.second, search_);
+  }
+}
+
+bool PrmPlanner::crossesObstacle(TGlobalOrd o1, TGlobalOrd o2) const{
+  for(auto const &o: obstacles_){
+    if(distanceToSegment(o.centre, o1, o2) <= o.radius){
+      return true;
+    }
+  }
+
+  return false;
+}
+
+double PrmPlanner::distanceToSegment(TGlobalOrd ord, TGlobalOrd o1, TGlobalOrd o2){
+  double dx = o2.x - o1.x, dy = o2.y - o1.y;
+  double length = dx * dx + dy * dy;
+
+  //The closest point on the line to ord, clamped to the segment
+  double t = length > 0 ? ((ord.x - o1.x) * dx + (ord.y - o1.y) * dy) / length : 0;
+  t = std::max(0.0, std::min(1.0, t));
+
+  TGlobalOrd closest{o1.x + t * dx, o1.y + t * dy};
+  return distance(closest, ord);
+}
+
+unsigned long PrmPlanner::searchExpansions() const{
+  return search_.expansions;
+}
+
+void PrmPlanner::setQueryMethod(TQueryMethod method){
+  queryMethod_ = method;
+}
+
+unsigned long PrmPlanner::buildHierarchy(){
+  hierarchy_.build(graph_);
+  hierarchyCurrent_ = true;
+
+  return hierarchy_.shortcuts();
+}
+
+Graph PrmPlanner::networkGraph(unsigned long &version) const{
+  version = networkVersion_;
+  return graph_;
+}
+
+bool PrmPlanner::installHierarchy(ContractionHierarchy hierarchy, unsigned long version){
+  if(version != networkVersion_){
+    return false; //Built from a network that has since changed
+  }
+
+  hierarchy_ = std::move(hierarchy);
+  hierarchyCurrent_ = true;
+
+  return true;
+}
+
+bool PrmPlanner::hierarchyCurrent() const{
+  return hierarchyCurrent_;
+}
+
+bool PrmPlanner::saveRoadmap(const std::string &file) const{
+  std::ofstream out(file);
+  if(!out){
+    return false;
+  }
+
+  out << std::setprecision(17);
+  out << "prm_sim_roadmap " << PLANNER_ROADMAP_VERSION << "\n";
+
+  out << "nodes " << network_.size() << "\n";
+  for(auto const &node: network_){
+    out << node.first << " " << node.second.x << " " << node.second.y << "\n";
+  }
+
+  std::vector<std::tuple<vertex, vertex, weight>> edges;
+  for(auto const &node: graph_.container()){
+    for(auto const &e: node.second){
+      if(node.first < e.first){
+        edges.push_back(std::make_tuple(node.first, e.first, e.second));
+      }
+    }
+  }
+
+  out << "edges " << edges.size() << "\n";
+  for(auto const &e: edges){
+    out << std::get<0>(e) << " " << std::get<1>(e) << " " << std::get<2>(e) << "\n";
+  }
+
+  //Without its guards, a loaded Visibility-PRM would keep every later sample
+  out << "guards " << guards_.size() << "\n";
+  for(auto const &guard: guards_){
+    out << guard << "\n";
+  }
+
+  //A stale hierarchy is left out, as it would be no use once loaded
+  if(hierarchyCurrent_){
+    hierarchy_.save(out);
+  } else {
+    ContractionHierarchy().save(out);
+  }
+
+  return out.good();
+}
+
+bool PrmPlanner::loadRoadmap(const std::string &file){
+  std::ifstream in(file);
+  std::string tag;
+  unsigned int version;
+  size_t nodes, edgeCount;
+
+  if(!(in >> tag >> version) || tag != "prm_sim_roadmap" || version != PLANNER_ROADMAP_VERSION){
+    return false;
+  }
+
+  //Everything is read before the network is touched, so a bad file leaves it as it was
+  if(!(in >> tag >> nodes) || tag != "nodes"){
+    return false;
+  }
+
+  std::vector<TGlobalOrd> ordinates(nodes);
+  for(vertex v = 0; v < nodes; v++){
+    vertex id;
+    if(!(in >> id >> ordinates[v].x >> ordinates[v].y) || id != v){
+      return false; //Verticies are allocated sequentially, so must be saved that way
     }
+  }
 
-    if(violatingSpace(randomOrd, r)){
-      continue; //We want uniform distribution, skip
+  if(!(in >> tag >> edgeCount) || tag != "edges"){
+    return false;
+  }
+
+  std::vector<std::tuple<vertex, vertex, weight>> edges(edgeCount);
+  for(auto &e: edges){
+    if(!(in >> std::get<0>(e) >> std::get<1>(e) >> std::get<2>(e)) ||
+       std::get<0>(e) >= nodes || std::get<1>(e) >= nodes){
+      return false;
     }
+  }
 
-    //Its passed all checks, add the ordinate to the graph!
-    addOrdinate(randomOrd);
+  size_t guardCount;
+  if(!(in >> tag >> guardCount) || tag != "guards"){
+    return false;
   }
 
-  //strengthen the network by joining it with the new nodes
-  joinNetwork(cspace, density_);
+  std::vector<vertex> guards(guardCount);
+  for(auto &guard: guards){
+    if(!(in >> guard) || guard >= nodes){
+      return false;
+    }
+  }
 
-  return query(cspace, start, goal);
-}
+  ContractionHierarchy hierarchy;
+  if(!hierarchy.load(in)){
+    return false;
+  }
 
-std::vector<TGlobalOrd> PrmPlanner::query(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal){
-  vertex vStart, vGoal;
+  //A hierarchy of some other network would find paths along edges that don't exist
+  Graph loaded(std::numeric_limits<unsigned int>::max());
+  for(vertex v = 0; v < nodes; v++){
+    loaded.addVertex(v);
+  }
+  for(auto const &e: edges){
+    loaded.addEdge(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+  }
 
-  if(!lookup(start, vStart) || !lookup(goal, vGoal)){
-    return std::vector<TGlobalOrd>();
+  if(!hierarchy.matches(loaded)){
+    return false;
   }
 
-  //Assumes the path has already been found
-  std::vector<vertex> vPath = graph_.shortestPath(vStart, vGoal);
-  if(vPath.size() > 0){
-    return optimisePath(cspace, toOrdPath(vPath));
+  //Saved nodes may have more neighbours than density, the limit is restored afterwards
+  graph_ = Graph(std::numeric_limits<unsigned int>::max());
+  network_.clear();
+  ordinates_.clear();
+  pixels_.clear();
+  components_.clear();
+  guards_.clear();
+  nextVertexId_ = 0;
+  search_ = TIncrementalSearch();
+  obstacles_.clear();
+  blocked_.clear();
+  edgeBuckets_.clear();
+  blockedStale_ = false;
+  hierarchyCurrent_ = false;
+  resetOverlay();
+  resetRoadmap();
+  networkVersion_++;
+
+  for(auto const &ordinate: ordinates){
+    addOrdinate(ordinate);
   }
 
-  return std::vector<TGlobalOrd>();
+  for(auto const &e: edges){
+    connect(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+  }
+
+  setConnectionStrategy(connection_);
+  joined_ = nextVertexId_;
+  guards_ = guards;
+
+  hierarchy_ = std::move(hierarchy);
+  hierarchyCurrent_ = !hierarchy_.empty();
+
+  return true;
 }
 
 void PrmPlanner::embedNode(cv::Mat &cspace, vertex node, unsigned int k, bool retry){
-  std::vector<TGlobalOrd> neighbours;
-  TGlobalOrd nodeOrd = network_[node];
+  std::vector<vertex> neighbours;
 
   //Get all nodes in the network ordered by distance to this node
   neighbours = getNeighbours(cspace, node, false);
@@ -139,17 +943,14 @@ void PrmPlanner::embedNode(cv::Mat &cspace, vertex node, unsigned int k, bool re
       break;
     }
 
-    vertex vNeighbour;
-    if(!lookup(neighbour, vNeighbour)){
-      //something went wrong adding this neighbour, continue to next
-      continue;
-    }
+    //Attempt to connect to neighbour, an existing edge needn't be checked again
+    weight w;
+    if(!graph_.hasEdge(node, neighbour)){
+      edgeChecks_++;
 
-    //Attempt to connect to neighbour
-    cv::Point pCurrent = lmap_.convertToPoint(reference_, nodeOrd);
-    cv::Point pN = lmap_.convertToPoint(reference_, neighbour);
-    if(lmap_.canConnect(cspace,pCurrent,pN)){
-      connected = graph_.addEdge(node, vNeighbour, distance(nodeOrd, neighbour));
+      if(edgeWeight(cspace, node, neighbour, w)){
+        connected = connect(node, neighbour, w);
+      }
     }
 
     if(connected){
@@ -162,7 +963,44 @@ void PrmPlanner::embedNode(cv::Mat &cspace, vertex node, unsigned int k, bool re
   }
 }
 
+bool PrmPlanner::edgeWeight(cv::Mat &cspace, vertex v, vertex u, weight &w) const{
+  if(!usingCosts(cspace)){
+    if(!lmap_.canConnect(cspace, pixel(v), pixel(u))){
+      return false;
+    }
+
+    w = distance(network_.at(v), network_.at(u));
+    return true;
+  }
+
+  double meanCost;
+  if(!lmap_.canConnect(cspace, costs_, pixel(v), pixel(u), meanCost)){
+    return false;
+  }
+
+  w = distance(network_.at(v), network_.at(u)) * (1.0 + costWeight_ * meanCost);
+  return true;
+}
+
+bool PrmPlanner::usingCosts(cv::Mat &cspace) const{
+  //A cost map for a different sized cspace can't be used
+  return !costs_.empty() && costs_.rows == cspace.rows && costs_.cols == cspace.cols;
+}
+
 void PrmPlanner::joinNetwork(cv::Mat &cspace, unsigned int k){
+  if(connection_ == CONNECT_VISIBILITY){
+    //Connectors were joined as they were added, any more edges would only grow the network
+    joined_ = nextVertexId_;
+    return;
+  }
+
+  if(connection_ == CONNECT_PRM_STAR){
+    //Only the new nodes are joined, the older ones were joined to their
+    //neighbours (at the time) when they were added
+    joinNewNodes(cspace, connectionK());
+    return;
+  }
+
   //Attempt to connect each node in the network to its k closest neighbours
   //Nodes that have the least amount of connections are embedded first
   for(auto const &node: prioritiseNodes()){
@@ -172,6 +1010,125 @@ void PrmPlanner::joinNetwork(cv::Mat &cspace, unsigned int k){
 
     embedNode(cspace, node, k, false);
   }
+
+  joined_ = nextVertexId_;
+}
+
+void PrmPlanner::joinNewNodes(cv::Mat &cspace, unsigned int k){
+  for(auto iter = network_.lower_bound(joined_); iter != network_.end(); ++iter){
+    embedNode(cspace, iter->first, k, false);
+  }
+
+  joined_ = nextVertexId_;
+}
+
+bool PrmPlanner::addVisibleNode(cv::Mat &cspace, TGlobalOrd ordinate){
+  cv::Point p = lmap_.convertToPoint(reference_, ordinate);
+  std::vector<vertex> visible;    //A visible guard from each component
+  std::vector<vertex> seen;       //The components of the visible guards
+
+  for(auto const &guard: guards_){
+    vertex c = component(guard);
+    if(std::find(seen.begin(), seen.end(), c) != seen.end()){
+      continue; //Another guard of this component is already visible
+    }
+
+    edgeChecks_++;
+    if(lmap_.canConnect(cspace, p, pixel(guard))){
+      visible.push_back(guard);
+      seen.push_back(c);
+    }
+  }
+
+  if(visible.size() == 1){
+    return false; //Only adds redundant paths within a component
+  }
+
+  vertex v = addOrdinate(ordinate);
+
+  if(visible.empty()){
+    guards_.push_back(v);
+    return true;
+  }
+
+  //A connector, joining each of the components it sees
+  for(auto const &guard: visible){
+    weight w;
+    if(edgeWeight(cspace, v, guard, w)){
+      connect(v, guard, w);
+    }
+  }
+
+  return true;
+}
+
+bool PrmPlanner::biasSample(cv::Mat &cspace, std::default_random_engine &generator, TGlobalOrd &ordinate){
+  //A bridge must straddle a gap, so its pair is drawn further apart
+  std::normal_distribution<double> spread(0.0, sampling_ == SAMPLE_BRIDGE ? PLANNER_BRIDGE_SPREAD
+                                                                          : PLANNER_GAUSSIAN_SPREAD);
+  TGlobalOrd near = {ordinate.x + spread(generator), ordinate.y + spread(generator)};
+
+  auto free = [&](TGlobalOrd ord){ return lmap_.isAccessible(cspace, lmap_.convertToPoint(reference_, ord)); };
+  bool firstFree = free(ordinate);
+  bool nearFree = free(near);
+
+  if(sampling_ == SAMPLE_GAUSSIAN){
+    //Only one of the pair being free means it lies close to an obstacle
+    if(firstFree == nearFree){
+      return false;
+    }
+
+    if(nearFree){
+      ordinate = near;
+    }
+
+    return true;
+  }
+
+  //A free point bridging two blocked points lies in a narrow gap
+  if(firstFree || nearFree){
+    return false;
+  }
+
+  TGlobalOrd middle = {(ordinate.x + near.x) / 2.0, (ordinate.y + near.y) / 2.0};
+  if(!free(middle)){
+    return false;
+  }
+
+  ordinate = middle;
+  return true;
+}
+
+vertex PrmPlanner::component(vertex v){
+  //Path halving, each vertex visited is pointed at its grandparent
+  while(components_[v] != v){
+    components_[v] = components_[components_[v]];
+    v = components_[v];
+  }
+
+  return v;
+}
+
+void PrmPlanner::rebuildComponents(){
+  for(vertex v = 0; v < components_.size(); v++){
+    components_[v] = v;
+  }
+
+  for(auto const &node: graph_.container()){
+    for(auto const &e: node.second){
+      if(e.first > node.first){
+        components_[component(node.first)] = component(e.first);
+      }
+    }
+  }
+}
+
+unsigned int PrmPlanner::connectionK() const{
+  if(network_.size() < 2){
+    return 1;
+  }
+
+  return std::max(1u, (unsigned int)std::ceil(PLANNER_PRM_STAR_K * std::log((double)network_.size())));
 }
 
 void PrmPlanner::showOverlay(cv::Mat &space, std::vector<TGlobalOrd> path){
@@ -182,48 +1139,156 @@ void PrmPlanner::showOverlay(cv::Mat &space, std::vector<TGlobalOrd> path){
   lmap_.overlayPath(space, pPath);
 }
 
-std::vector<TGlobalOrd> PrmPlanner::optimisePath(cv::Mat &cspace, std::vector<TGlobalOrd> path){
+void PrmPlanner::updateOverlay(cv::Mat &layer, const cv::Mat &base){
+  if(overlayChanges_.stale){
+    lmap_.overlayPRM(layer, composePRM());
+  } else {
+    eraseRemovedEdges(layer, base);
+    lmap_.overlayPRM(layer, composeNewPRM());
+  }
+
+  overlayChanges_.stale = false;
+  overlayChanges_.verticies.clear();
+  overlayChanges_.edges.clear();
+  overlayChanges_.removedEdges.clear();
+}
+
+void PrmPlanner::eraseRemovedEdges(cv::Mat &layer, const cv::Mat &base){
+  cv::Rect bounds(0, 0, layer.cols, layer.rows);
+  std::vector<std::pair<cv::Point, cv::Point>> redraw;
+  edgeSet near;
+
+  for(auto const &e: overlayChanges_.removedEdges){
+    cv::Point p = pixel(e.first), q = pixel(e.second);
+
+    //Restore the pixels the edge was drawn over, its ends are still nodes
+    cv::LineIterator it(layer, p, q);
+    for(int i = 0; i < it.count; i++, ++it){
+      cv::Point at = it.pos();
+      layer.at<cv::Vec3b>(at) = base.at<cv::Vec3b>(at);
+    }
+    redraw.push_back(std::make_pair(p, p));
+    redraw.push_back(std::make_pair(q, q));
+
+    //Any edge that crossed it may have lost a pixel
+    cv::Rect box = cv::Rect(cv::Point(std::min(p.x, q.x), std::min(p.y, q.y)),
+                            cv::Point(std::max(p.x, q.x) + 1, std::max(p.y, q.y) + 1)) & bounds;
+    if(box.area() > 0){
+      edgesWithin(box, near);
+    }
+  }
+
+  for(auto const &e: near){
+    redraw.push_back(std::make_pair(pixel(e.first), pixel(e.second)));
+  }
+
+  lmap_.overlayPRM(layer, redraw);
+}
+
+void PrmPlanner::resetOverlay(){
+  resetChanges(overlayChanges_);
+}
+
+void PrmPlanner::showPath(cv::Mat &space, std::vector<TGlobalOrd> path){
+  lmap_.overlayPath(space, toPointPath(path));
+}
+
+TRoadmap PrmPlanner::roadmapChanges(){
+  TRoadmap roadmap;
+  roadmap.reset = roadmapChanges_.stale;
+
+  if(roadmapChanges_.stale){
+    //Send everything, each undirected edge once from its lower vertex
+    for(auto const &node: graph_.container()){
+      roadmap.nodes.push_back(std::make_pair(node.first, network_[node.first]));
+
+      for(auto const &neighbour: node.second){
+        if(node.first < neighbour.first){
+          roadmap.edges.push_back(std::make_pair(node.first, neighbour.first));
+        }
+      }
+    }
+  } else {
+    for(auto const &v: roadmapChanges_.verticies){
+      roadmap.nodes.push_back(std::make_pair(v, network_[v]));
+    }
+
+    roadmap.edges = roadmapChanges_.edges;
+    roadmap.removedEdges = roadmapChanges_.removedEdges;
+  }
+
+  roadmapChanges_.stale = false;
+  roadmapChanges_.verticies.clear();
+  roadmapChanges_.edges.clear();
+  roadmapChanges_.removedEdges.clear();
+
+  return roadmap;
+}
+
+void PrmPlanner::resetRoadmap(){
+  resetChanges(roadmapChanges_);
+}
+
+std::vector<TGlobalOrd> PrmPlanner::optimisePath(cv::Mat &cspace, const std::vector<vertex> &path) const{
   std::vector<TGlobalOrd> optPath;
+  std::vector<weight> pathWeight;
+
+  optimisePath(cspace, path, pathWeight, optPath);
+  return optPath;
+}
+
+void PrmPlanner::optimisePath(cv::Mat &cspace, const std::vector<vertex> &path,
+                              std::vector<weight> &pathWeight, std::vector<TGlobalOrd> &optPath) const{
+  optPath.clear();
 
   if(path.size() == 0){
-    return optPath; //No path to optimise return empty path
+    return; //No path to optimise return empty path
+  }
+
+  //The weight of the path from the start to each node, so that with a cost
+  //map we only take shortcuts that are no more costly than the path itself
+  pathWeight.assign(path.size(), 0);
+  for(unsigned int i = 1; i < path.size(); i++){
+    pathWeight[i] = pathWeight[i - 1] + graph_.getWeight(path[i - 1], path[i]);
   }
 
   //Start with the first node
-  optPath.push_back(path.at(0));
+  unsigned int current = 0;
+  optPath.push_back(network_.at(path.at(current)));
 
   //While the goal is not in the optimised path
-  while(std::find(optPath.begin(), optPath.end(), path.back()) == optPath.end()){
-    TGlobalOrd ordCurr = optPath.back();
-    cv::Point pCurrent = lmap_.convertToPoint(reference_, ordCurr);
-
+  while(current < path.size() - 1){
     //Starting at the end of the path and moving backwards, determine
-    //if we can directly connect to the current ordinate
-    for(unsigned i = path.size(); i-- > 0;){
-      if(path[i] == ordCurr){
-        break; //We have reached the current ordinate
+    //if we can directly connect to the current node. The next node in the
+    //path is always connected to the current one by an edge.
+    unsigned int next = current + 1;
+    for(unsigned int i = path.size() - 1; i > current + 1; i--){
+      weight w;
+      if(!edgeWeight(cspace, path[current], path[i], w) ||
+         crossesObstacle(network_.at(path[current]), network_.at(path[i]))){
+        continue;
       }
 
-      cv::Point pTest = lmap_.convertToPoint(reference_, path[i]);
-      if(lmap_.canConnect(cspace, pCurrent, pTest)){
-        optPath.push_back(path[i]);
+      if(!usingCosts(cspace) || w <= pathWeight[i] - pathWeight[current]){
+        next = i;
         break; //We have found the earliest node to directly connect to
       }
     }
-  }
 
-  return optPath;
+    optPath.push_back(network_.at(path[next]));
+    current = next;
+  }
 }
 
 std::vector<std::pair<cv::Point, cv::Point>> PrmPlanner::composePRM()
 {
   std::vector<std::pair<cv::Point, cv::Point>> prm;
-  std::map<vertex, edges> nodes = graph_.container();
+  const std::map<vertex, edges> &nodes = graph_.container();
 
   //For each vertex in our internal graph, create a pair of points
   //between itself and all its neighbours
   for(auto const &node: nodes){
-    cv::Point pCurrent = lmap_.convertToPoint(reference_, network_[node.first]);
+    cv::Point pCurrent = pixel(node.first);
 
     //It has no neighbours, we must still add it to the prm though
     if(node.second.size() == 0){
@@ -231,44 +1296,46 @@ std::vector<std::pair<cv::Point, cv::Point>> PrmPlanner::composePRM()
     }
 
     for(auto const &neighbour: node.second){
-      cv::Point pNeighbour = lmap_.convertToPoint(reference_, network_[neighbour.first]);
-
-      //Ensure that we are only adding node pairs to the prm that are unique! (no two way connections)
-      auto it = std::find_if(prm.begin(), prm.end(),
-          [pCurrent, pNeighbour](const std::pair<cv::Point, cv::Point>& element){ return
-            element.first == pNeighbour && element.second == pCurrent;});
-
-      if(it == prm.end()){
-        prm.push_back(std::make_pair(pCurrent, pNeighbour));
+      //The graph is undirected, so each edge appears in both verticies' lists.
+      //Only add it from the lower vertex so node pairs in the prm are unique.
+      if(neighbour.first < node.first){
+        continue;
       }
+
+      prm.push_back(std::make_pair(pCurrent, pixel(neighbour.first)));
     }
   }
 
   return prm;
 }
 
-std::vector<cv::Point> PrmPlanner::toPointPath(std::vector<TGlobalOrd> path){
-  std::vector<cv::Point> pointPath;
-  for(auto const &ord: path){
-    pointPath.push_back(lmap_.convertToPoint(reference_, ord));
+std::vector<std::pair<cv::Point, cv::Point>> PrmPlanner::composeNewPRM()
+{
+  std::vector<std::pair<cv::Point, cv::Point>> prm;
+
+  //New nodes are drawn on their own, any edges they have are drawn below
+  for(auto const &v: overlayChanges_.verticies){
+    prm.push_back(std::make_pair(pixel(v), pixel(v)));
   }
 
-  return pointPath;
-}
+  for(auto const &e: overlayChanges_.edges){
+    prm.push_back(std::make_pair(pixel(e.first), pixel(e.second)));
+  }
 
-std::vector<TGlobalOrd> PrmPlanner::toOrdPath(std::vector<vertex> path){
-  std::vector<TGlobalOrd> ordPath;
+  return prm;
+}
 
-  for(auto const &v: path){
-    ordPath.push_back(network_[v]);
-  }
+std::vector<cv::Point> PrmPlanner::toPointPath(std::vector<TGlobalOrd> path){
+  std::vector<cv::Point> pointPath;
+  lmap_.convertToPoints(reference_, path, pointPath);
 
-  return ordPath;
+  return pointPath;
 }
 
-std::vector<TGlobalOrd> PrmPlanner::getNeighbours(cv::Mat &cspace, vertex node, bool shouldConnect){
-  std::vector<TGlobalOrd> neighbours;
+std::vector<vertex> PrmPlanner::getNeighbours(cv::Mat &cspace, vertex node, bool shouldConnect){
+  std::vector<std::pair<vertex, double>> candidates;
   TGlobalOrd nodeOrd = network_[node];
+  cv::Point pCurrent = pixel(node);
 
   //Attempt to connect each node in network to k closest neighbours
   for(auto const &neighbour: network_){
@@ -278,10 +1345,7 @@ std::vector<TGlobalOrd> PrmPlanner::getNeighbours(cv::Mat &cspace, vertex node,
 
     //If we care about our ability to connect, then we must check
     if(shouldConnect){
-      cv::Point pCurrent = lmap_.convertToPoint(reference_, nodeOrd);
-      cv::Point pN = lmap_.convertToPoint(reference_, neighbour.second);
-
-      if(!lmap_.canConnect(cspace, pCurrent, pN)){
+      if(!lmap_.canConnect(cspace, pCurrent, pixel(neighbour.first))){
         continue; //Will skip this neighbour
       }
 
@@ -291,12 +1355,18 @@ std::vector<TGlobalOrd> PrmPlanner::getNeighbours(cv::Mat &cspace, vertex node,
     }
 
     //Add neighbour to list
-    neighbours.push_back(neighbour.second);
+    candidates.push_back(std::make_pair(neighbour.first, distance(nodeOrd, neighbour.second)));
   }
 
   //Sort neighbours by distance.
-  std::sort(neighbours.begin(), neighbours.end(),[nodeOrd](const TGlobalOrd &lhs, const TGlobalOrd &rhs){
-    return distance(lhs, nodeOrd) < distance(rhs, nodeOrd);});
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<vertex, double> &lhs, const std::pair<vertex, double> &rhs){
+    return lhs.second < rhs.second;});
+
+  std::vector<vertex> neighbours;
+  for(auto const &candidate: candidates){
+    neighbours.push_back(candidate.first);
+  }
 
   return neighbours;
 }
@@ -352,18 +1422,157 @@ vertex PrmPlanner::addOrdinate(TGlobalOrd ordinate){
   vertex v = nextVertexId();
   graph_.addVertex(v);
   network_.insert(std::make_pair(v, ordinate));
+  ordinates_.insert(std::make_pair(std::make_pair(ordinate.x, ordinate.y), v));
+
+  //Cache the node's position within the OgMap, verticies are allocated sequentially
+  if(pixels_.size() <= v){
+    pixels_.resize(v + 1);
+  }
+  pixels_[v] = lmap_.convertToPoint(reference_, ordinate);
+
+  //Each vertex starts in a component of its own
+  if(components_.size() <= v){
+    components_.resize(v + 1);
+  }
+  components_[v] = v;
+
+  trackVertex(v);
 
   return v;
 }
 
-bool PrmPlanner::existsAsVertex(TGlobalOrd ord){
-  for(auto &v: network_){
-    if(v.second == ord){
-      return true;
+bool PrmPlanner::connect(vertex v, vertex u, weight w){
+  if(!graph_.addEdge(v, u, w)){
+    return false;
+  }
+
+  components_[component(v)] = component(u);
+
+  //Only the new edge is tested against the obstacles, the rest of blocked_ is still current
+  if(!obstacles_.empty() && crossesObstacle(network_.at(v), network_.at(u))){
+    blocked_.insert(v < u ? std::make_pair(v, u) : std::make_pair(u, v));
+  }
+  graph_.repairEdge(v, u, search_);
+  networkVersion_++;
+
+  //A new node joined by this edge alone is attached below the hierarchy, any other
+  //edge could be part of a shorter path the hierarchy doesn't know about
+  if(hierarchyCurrent_){
+    bool attached = (graph_.getEdgeCount(v) == 1 && hierarchy_.attach(v, u, w)) ||
+                    (graph_.getEdgeCount(u) == 1 && hierarchy_.attach(u, v, w));
+    hierarchyCurrent_ = attached;
+  }
+
+  trackEdge(v, u);
+  indexEdge(v, u, true);
+
+  return true;
+}
+
+void PrmPlanner::trackVertex(vertex v){
+  //Stale changes will be consumed in full anyway, so don't grow them
+  for(TNetworkChanges *changes: {&overlayChanges_, &roadmapChanges_}){
+    if(!changes->stale){
+      changes->verticies.push_back(v);
     }
   }
+}
 
-  return false;
+void PrmPlanner::trackEdge(vertex v, vertex u){
+  for(TNetworkChanges *changes: {&overlayChanges_, &roadmapChanges_}){
+    if(!changes->stale){
+      changes->edges.push_back(std::make_pair(v, u));
+    }
+  }
+}
+
+void PrmPlanner::indexEdge(vertex v, vertex u, bool add){
+  std::pair<vertex, vertex> e = v < u ? std::make_pair(v, u) : std::make_pair(u, v);
+  cv::Rect squares = bucketRange(network_.at(v), network_.at(u));
+
+  for(int y = squares.y; y < squares.y + squares.height; y++){
+    for(int x = squares.x; x < squares.x + squares.width; x++){
+      if(add){
+        edgeBuckets_[std::make_pair(x, y)].insert(e);
+        continue;
+      }
+
+      auto bucket = edgeBuckets_.find(std::make_pair(x, y));
+      if(bucket != edgeBuckets_.end()){
+        bucket->second.erase(e);
+        if(bucket->second.empty()){
+          edgeBuckets_.erase(bucket);
+        }
+      }
+    }
+  }
+}
+
+void PrmPlanner::edgesWithin(cv::Rect region, edgeSet &found) const{
+  //Only the edges spanning the squares under the region can cross it. The
+  //corners are a pixel wide, as an edge's ends are rounded to pixels
+  TGlobalOrd corner1 = lmap_.convertToOrd(reference_, region.tl() - cv::Point(1, 1));
+  TGlobalOrd corner2 = lmap_.convertToOrd(reference_, region.br());
+  cv::Rect squares = bucketRange(corner1, corner2);
+
+  for(int y = squares.y; y < squares.y + squares.height; y++){
+    for(int x = squares.x; x < squares.x + squares.width; x++){
+      auto const bucket = edgeBuckets_.find(std::make_pair(x, y));
+      if(bucket == edgeBuckets_.end()){
+        continue;
+      }
+
+      for(auto const &e: bucket->second){
+        //An edge can only cross the region if its bounding box overlaps it
+        cv::Point p = pixel(e.first), q = pixel(e.second);
+        if(std::max(p.x, q.x) < region.x || std::min(p.x, q.x) >= region.x + region.width ||
+           std::max(p.y, q.y) < region.y || std::min(p.y, q.y) >= region.y + region.height){
+          continue;
+        }
+
+        found.insert(e);
+      }
+    }
+  }
+}
+
+cv::Rect PrmPlanner::bucketRange(TGlobalOrd o1, TGlobalOrd o2) const{
+  int x1 = std::floor(std::min(o1.x, o2.x) / PLANNER_EDGE_BUCKET);
+  int y1 = std::floor(std::min(o1.y, o2.y) / PLANNER_EDGE_BUCKET);
+  int x2 = std::floor(std::max(o1.x, o2.x) / PLANNER_EDGE_BUCKET);
+  int y2 = std::floor(std::max(o1.y, o2.y) / PLANNER_EDGE_BUCKET);
+
+  return cv::Rect(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+}
+
+void PrmPlanner::trackRemovedEdge(vertex v, vertex u){
+  for(TNetworkChanges *changes: {&overlayChanges_, &roadmapChanges_}){
+    if(changes->stale){
+      continue;
+    }
+
+    //An edge added since the changes were consumed is no longer sent
+    auto added = std::find_if(changes->edges.begin(), changes->edges.end(),
+                              [v, u](const std::pair<vertex, vertex> &e){
+                                return (e.first == v && e.second == u) || (e.first == u && e.second == v);
+                              });
+    if(added != changes->edges.end()){
+      changes->edges.erase(added);
+    }
+
+    changes->removedEdges.push_back(std::make_pair(v, u));
+  }
+}
+
+void PrmPlanner::resetChanges(TNetworkChanges &changes){
+  changes.stale = true;
+  changes.verticies.clear();
+  changes.edges.clear();
+  changes.removedEdges.clear();
+}
+
+bool PrmPlanner::existsAsVertex(TGlobalOrd ord) const{
+  return ordinates_.find(std::make_pair(ord.x, ord.y)) != ordinates_.end();
 }
 
 vertex PrmPlanner::nextVertexId(){
@@ -373,15 +1582,14 @@ vertex PrmPlanner::nextVertexId(){
   return temp;
 }
 
-bool PrmPlanner::lookup(TGlobalOrd ord, vertex &v){
-  for(auto &vert: network_){
-    if(vert.second == ord){
-      v = vert.first;
-      return true;
-    }
+bool PrmPlanner::lookup(TGlobalOrd ord, vertex &v) const{
+  auto const it = ordinates_.find(std::make_pair(ord.x, ord.y));
+  if(it == ordinates_.end()){
+    return false;
   }
 
-  return false;
+  v = it->second;
+  return true;
 }
 
 bool PrmPlanner::ordinateAccessible(cv::Mat &cspace, TGlobalOrd ordinate){
@@ -389,8 +1597,36 @@ bool PrmPlanner::ordinateAccessible(cv::Mat &cspace, TGlobalOrd ordinate){
       lmap_.isAccessible(cspace, lmap_.convertToPoint(reference_, ordinate));
 }
 
+cv::Mat PrmPlanner::clearanceCost(cv::Mat &cspace, double clearance){
+  return lmap_.clearanceCost(cspace, clearance);
+}
+
+void PrmPlanner::setCostMap(const cv::Mat &costs, double weight){
+  costs_ = costs;
+  costWeight_ = weight;
+}
+
 void PrmPlanner::expandConfigSpace(cv::Mat &space, double robotDiameter){
-  lmap_.expandConfigSpace(space, lmap_.convertToPoint(reference_, reference_), robotDiameter);
+  expandConfigSpace(space, robotDiameter, reference_);
+}
+
+void PrmPlanner::expandConfigSpace(cv::Mat &space, double robotDiameter, TGlobalOrd robot){
+  extent_ = lmap_.expandKnownConfigSpace(space, lmap_.convertToPoint(reference_, robot),
+                                         robotDiameter, PLANNER_EXTENT_MARGIN);
+}
+
+void PrmPlanner::setKnownExtent(const cv::Rect &extent){
+  extent_ = extent;
+}
+
+cv::Rect PrmPlanner::samplingRegion(const cv::Mat &cspace) const{
+  cv::Rect whole(0, 0, cspace.cols, cspace.rows);
+
+  if(extent_.empty()){
+    return whole;
+  }
+
+  return extent_ & whole;
 }
 
 double PrmPlanner::distance(TGlobalOrd o1, TGlobalOrd o2){
@@ -401,15 +1637,83 @@ double PrmPlanner::distance(TGlobalOrd o1, TGlobalOrd o2){
 }
 
 void PrmPlanner::setReference(const TGlobalOrd reference){
+  bool moved = (reference.x != reference_.x || reference.y != reference_.y);
+
   reference_.x = reference.x;
   reference_.y = reference.y;
+
+  if(moved){
+    //Every node will have moved within the OgMap, as has the known extent
+    resetOverlay();
+    refreshPixels();
+    extent_ = cv::Rect();
+  }
 }
 
 void PrmPlanner::setMapSize(double mapSize){
-  lmap_.setMapSize(mapSize);
+  setMapSize(mapSize, mapSize);
+}
+
+void PrmPlanner::setMapSize(double width, double height){
+  lmap_.setMapSize(width, height);
+  resetOverlay();
+  refreshPixels();
+  extent_ = cv::Rect();
+}
+
+void PrmPlanner::setOrigin(cv::Point origin){
+  lmap_.setOrigin(origin);
+  resetOverlay();
+  refreshPixels();
+  extent_ = cv::Rect();
+}
+
+void PrmPlanner::setCollisionBackend(TCollisionBackend backend){
+  lmap_.setCollisionBackend(backend);
+}
+
+void PrmPlanner::setConnectionStrategy(TConnectionStrategy strategy){
+  connection_ = strategy;
+
+  //k-PRM* relies on nodes gaining neighbours as the network grows, and a
+  //Visibility-PRM guard on joining every connector that sees it
+  if(strategy != CONNECT_FIXED_K){
+    graph_.setMaxNeighbours(std::numeric_limits<unsigned int>::max());
+  } else {
+    graph_.setMaxNeighbours(density_);
+  }
+}
+
+void PrmPlanner::setSamplingStrategy(TSamplingStrategy strategy){
+  sampling_ = strategy;
+}
+
+unsigned long PrmPlanner::edgeChecks() const{
+  return edgeChecks_;
 }
 
 void PrmPlanner::setResolution(double resolution){
   lmap_.setResolution(resolution);
+  resetOverlay();
+  refreshPixels();
+  extent_ = cv::Rect();
+}
+
+void PrmPlanner::refreshPixels(){
+  std::vector<TGlobalOrd> ords;
+  std::vector<cv::Point> points;
+
+  for(auto const &node: network_){
+    ords.push_back(node.second);
+  }
+
+  lmap_.convertToPoints(reference_, ords, points);
+
+  //network_ is ordered by vertex, so points line up with the verticies
+  pixels_.assign(nextVertexId_, cv::Point());
+  unsigned int i = 0;
+  for(auto const &node: network_){
+    pixels_[node.first] = points[i++];
+  }
 }
 
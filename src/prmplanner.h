@@ -18,17 +18,94 @@
 #ifndef PRMPLANNER_H
 #define PRMPLANNER_H
 
+#include <chrono>
 #include <map>
+#include <memory>
+#include <random>
+#include <string>
 #include <utility>
 
 #include "localmap.h"
 #include "graph.h"
+#include "contractionhierarchy.h"
 #include "types.h"
+#include "workpool.h"
 
 //PrmPlanner default constants
 const double PLANNER_DEF_MAP_SIZE = 20.0;   /*!< The default ogmap size is 20x20m */
 const double PLANNER_DEF_MAP_RES = 0.1;     /*!< The default ogmap resolution is 0.1m per pixel */
 const unsigned int PLANNER_DEF_DENSITY = 5; /*!< The default max amount of neighbours a node in the network can have */
+const double PLANNER_EXTENT_MARGIN = 1.0;   /*!< Margin (m) around the known part of the ogmap that is sampled */
+const unsigned int PLANNER_BUILD_NODES = 200;           /*!< The amount of nodes added to the network by each build() */
+const unsigned int PLANNER_MAX_SAMPLE_ATTEMPTS = 1000;  /*!< The max samples drawn per node added, before sampling gives up */
+const double PLANNER_PRM_STAR_K = 2.718281828 * 1.5;    /*!< k-PRM* constant e(1 + 1/d), for d = 2 dimensions */
+const unsigned int PLANNER_VISIBILITY_MAX_REJECTS = 500; /*!< Consecutive samples rejected by Visibility-PRM before the space is deemed covered */
+const double PLANNER_GAUSSIAN_SPREAD = 0.5; /*!< Standard deviation (m) between the pair of points drawn by SAMPLE_GAUSSIAN */
+const double PLANNER_BRIDGE_SPREAD = 1.0;   /*!< Standard deviation (m) between the pair of points drawn by SAMPLE_BRIDGE */
+const double PLANNER_SKELETON_SPACING = 2.0; /*!< The max distance (m) between nodes along a branch of the skeleton */
+const double PLANNER_UNIFORM_SHARE = 0.2;   /*!< Share of samples still drawn uniformly by obstacle biased samplers */
+const double PLANNER_REPAIR_MARGIN = 1.0;   /*!< Margin (m) around a blocked segment whose edges are checked again by checkPath() */
+const unsigned int PLANNER_REPAIR_ATTEMPTS = 5; /*!< The max local searches checkPath() makes to repair one blocked segment */
+const double PLANNER_EDGE_BUCKET = 1.0;      /*!< The size (m) of the squares of the world grid that edges are indexed by, see updateEdges() */
+const unsigned int PLANNER_ROADMAP_VERSION = 1; /*!< The version of the file written by saveRoadmap() */
+
+enum TConnectionStrategy /*!< How many neighbours each node in the network is joined to */
+{
+  CONNECT_FIXED_K,    /*!< Every node is joined to its density nearest neighbours each build, and has at most density */
+  CONNECT_PRM_STAR,   /*!< New nodes are joined once to their k = PLANNER_PRM_STAR_K * log(n) nearest neighbours */
+  CONNECT_VISIBILITY  /*!< Samples are only kept as guards or connectors between components (Visibility-PRM) */
+};
+
+enum TSamplingStrategy /*!< Where in the free space new nodes are sampled */
+{
+  SAMPLE_UNIFORM,     /*!< Uniformly across the known free space */
+  SAMPLE_GAUSSIAN,    /*!< Near obstacles, a free point of a pair (one free, one not) a short distance apart */
+  SAMPLE_BRIDGE       /*!< In narrow gaps, the free midpoint of a pair of points that are both within obstacles */
+};
+
+enum TPathStatus /*!< The result of checking a path against a new cspace */
+{
+  PATH_VALID,         /*!< Every segment of the path is still free */
+  PATH_REPAIRED,      /*!< Blocked segments were replaced by detours */
+  PATH_BLOCKED        /*!< A blocked segment couldn't be repaired locally, so a new path is needed */
+};
+
+enum TQueryMethod /*!< How query() searches the network */
+{
+  QUERY_DIJKSTRA,     /*!< A search of the whole network, see Graph::shortestPath() */
+  QUERY_HIERARCHY     /*!< Upward searches of the contraction hierarchy, while it is current (otherwise QUERY_DIJKSTRA) */
+};
+
+struct TNetworkChanges /*!< The parts of the network added (or edges removed) since they were last consumed */
+{
+  bool stale = true;                            /*!< TRUE if the whole network must be consumed, not just the changes */
+  std::vector<vertex> verticies;                /*!< Verticies added since last consumed */
+  std::vector<std::pair<vertex, vertex>> edges; /*!< Edges added since last consumed, and still in the network */
+  std::vector<std::pair<vertex, vertex>> removedEdges; /*!< Edges removed since last consumed */
+};
+
+struct TQueryWorkspace /*!< Scratch space for query(), reused so that queries don't allocate once it has grown */
+{
+  TSearchWorkspace forward;         /*!< The search of the network (or up from the start, for QUERY_HIERARCHY) */
+  TSearchWorkspace backward;        /*!< The search up from the goal, used by QUERY_HIERARCHY */
+  std::vector<vertex> path;         /*!< The verticies of the path found */
+  std::vector<weight> pathWeight;   /*!< The weight along path to each of its verticies, see optimisePath() */
+};
+
+struct TDynamicObstacle /*!< A transient obstacle (e.g. a person), which blocks edges until it expires */
+{
+  TGlobalOrd centre;                              /*!< The centre of the obstacle */
+  double radius;                                  /*!< Edges passing within this distance (m) of centre are blocked */
+  std::chrono::steady_clock::time_point expiry;   /*!< When the obstacle is forgotten */
+};
+
+struct TRoadmap /*!< A vector representation of (part of) the network in global ordinates */
+{
+  bool reset;                                         /*!< TRUE if this is the whole network, otherwise it only contains changes */
+  std::vector<std::pair<vertex, TGlobalOrd>> nodes;   /*!< The nodes, and their unique vertex ids */
+  std::vector<std::pair<vertex, vertex>> edges;       /*!< Undirected edges as pairs of vertex ids */
+  std::vector<std::pair<vertex, vertex>> removedEdges; /*!< Undirected edges removed, empty if reset */
+};
 
 class PrmPlanner
 {
@@ -37,9 +114,9 @@ public:
    */
   PrmPlanner();
 
-  /*! @brief Constructor for a PrmPlanner.
+  /*! @brief Constructor for a PrmPlanner, for square OgMaps.
    *
-   *  @param mapSize The size of the OgMap in meters (square maps only).
+   *  @param mapSize The size of the OgMap in meters.
    *  @param mapRes The resolution of the OgMaps provided to this object.
    *  @param density The density of the prm network (max neighbours a node can have).
    *
@@ -48,6 +125,18 @@ public:
    */
   PrmPlanner(double mapSize, double mapRes, unsigned int density);
 
+  /*! @brief Constructor for a PrmPlanner.
+   *
+   *  @param mapWidth The width (x) of the OgMap in meters.
+   *  @param mapHeight The height (y) of the OgMap in meters.
+   *  @param mapRes The resolution of the OgMaps provided to this object.
+   *  @param density The density of the prm network (max neighbours a node can have).
+   *
+   *  @note This will set the reference position to 0,0 (at the centre of the
+   *        OgMap) by default. To change this, call setReference() and setOrigin().
+   */
+  PrmPlanner(double mapWidth, double mapHeight, double mapRes, unsigned int density);
+
   /*! @brief Builds a prm network between a start and end ordinate.
    *
    *  @param cspace The OgMap to build the prm network within. Must be already expanded.
@@ -59,6 +148,51 @@ public:
    */
   std::vector<TGlobalOrd> build(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal);
 
+  /*! @brief Adds nodes to the prm network, without a start or goal.
+   *
+   *  Used to build the network ahead of any goals, so later goals may be
+   *  answered by query() alone. Only the new nodes are joined with the network
+   *  (see joinNewNodes()), so older nodes aren't collision checked again and,
+   *  with CONNECT_FIXED_K, a batch makes at most density edge checks per new
+   *  node. Finding each new node's neighbours still sorts the whole network
+   *  (see getNeighbours()), so a batch of b nodes into a network of n costs
+   *  O(b n log n).
+   *
+   *  @param cspace The OgMap to build the prm network within. Must be already expanded.
+   *  @param nodes The amount of nodes to add.
+   *  @return unsigned int - The amount of nodes added. This may be fewer than
+   *                         requested if free space is hard to find.
+   */
+  unsigned int densify(cv::Mat &cspace, unsigned int nodes);
+
+  /*! @brief Adds the skeleton (medial axis) of the free space to the network.
+   *
+   *  A deterministic alternative to sampling, suited to static maps. Nodes
+   *  are placed at the ends and junctions of the skeleton, and along its
+   *  branches wherever a straight edge would leave the free space (or every
+   *  PLANNER_SKELETON_SPACING). Neighbouring nodes along a branch are joined,
+   *  so the network has few nodes and keeps as far from obstacles as it can.
+   *  Later goals are joined to it by build() as usual.
+   *
+   *  @param cspace The OgMap to build the prm network within. Must be already expanded.
+   *  @return unsigned int - The amount of nodes added.
+   */
+  unsigned int buildSkeleton(cv::Mat &cspace);
+
+  /*! @brief Adds a skeleton found beforehand to the network.
+   *
+   *  @param cspace The OgMap to build the prm network within. Must be already expanded.
+   *  @param skeleton The skeleton of cspace, see LocalMap::skeleton().
+   *  @return unsigned int - The amount of nodes added.
+   */
+  unsigned int buildSkeleton(cv::Mat &cspace, const cv::Mat &skeleton);
+
+  /*! @brief Gets the amount of nodes in the prm network.
+   *
+   *  @return unsigned int - The amount of nodes.
+   */
+  unsigned int nodeCount() const;
+
   /*! @brief Query the network for a path between start and goal within cspace.
    *
    *  @param cspace The map configuration space. Must be already expanded.
@@ -70,6 +204,202 @@ public:
    */
   std::vector<TGlobalOrd> query(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal);
 
+  /*! @brief Finds a path between start and goal, repairing the previous replan().
+   *
+   *  A start or goal without edges is joined to the network as in build(),
+   *  but no nodes are sampled. While the goal is unchanged, the search is repaired
+   *  (see Graph::shortestPath(), TIncrementalSearch) rather than made again,
+   *  so as the robot moves and updateEdges() or build() change the network, a
+   *  replan only costs as much as the part of the network affected.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param start The starting ordinate. This is usually the robot's position.
+   *  @param goal  The goal ordiante to reach from start.
+   *  @return vector<TGlobalOrd> - An ordered vector of globalOrd's between start
+   *                              and goal. This will be empty if no path was
+   *                              discovered.
+   */
+  std::vector<TGlobalOrd> replan(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal);
+
+  /*! @brief Checks a path found earlier against a new cspace, and repairs it locally.
+   *
+   *  Only the segments of the path are checked (segments with an end outside
+   *  cspace can't be, and are assumed free). A blocked segment is replaced by
+   *  a detour between the nearest free waypoints either side of it, found by
+   *  searching the network between them. Edges within PLANNER_REPAIR_MARGIN
+   *  of the segment, and any on the detour, are checked again with
+   *  updateEdges() first, so the detour is free.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param path The path to check, which is repaired in place.
+   *  @return TPathStatus - Whether the path was valid, repaired or is still blocked.
+   *                        A blocked path is left as far as it was repaired.
+   */
+  TPathStatus checkPath(cv::Mat &cspace, std::vector<TGlobalOrd> &path);
+
+  /*! @brief Calculates the distance from an ordinate to the closest point on a segment.
+   *
+   *  @param ord The ordinate to measure from.
+   *  @param o1 The start of the segment.
+   *  @param o2 The end of the segment.
+   *  @return double - The distance (m) between ord and the segment.
+   */
+  static double distanceToSegment(TGlobalOrd ord, TGlobalOrd o1, TGlobalOrd o2);
+
+  /*! @brief Checks the edges of the network within a region against a new cspace.
+   *
+   *  Edges within cspace that may cross region are collision checked again,
+   *  so region need only bound the pixels that changed. Those that are
+   *  blocked are removed, and (with a cost map) the rest are reweighted.
+   *  Removed edges are recorded for updateOverlay() and roadmapChanges().
+   *
+   *  Edges are indexed by the squares of a world grid (PLANNER_EDGE_BUCKET)
+   *  they span, so only those in the squares under region are visited and
+   *  the cost depends on the size of region rather than the network.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param region The pixels of cspace that may have changed.
+   *  @return unsigned int - The amount of edges removed.
+   *
+   *  @note The components used by CONNECT_VISIBILITY are not split when an
+   *        edge is removed, so fewer connectors may be added afterwards.
+   */
+  unsigned int updateEdges(cv::Mat &cspace, cv::Rect region);
+
+  /*! @brief Checks the edges of the network within several regions against a new cspace.
+   *
+   *  As above, but an edge within more than one region is only checked once.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param regions The regions of cspace that may have changed, see LocalMap::changedRegions().
+   *  @return unsigned int - The amount of edges removed.
+   */
+  unsigned int updateEdges(cv::Mat &cspace, const std::vector<cv::Rect> &regions);
+
+  /*! @brief Blocks the network around a transient obstacle, until it expires.
+   *
+   *  Edges passing within radius of the obstacle are left out of searches
+   *  (by query(), build() and replan()), and path shortcuts may not cross it.
+   *  The network itself is not changed, so reacting to a moving obstacle only
+   *  costs a query, and the edges are used again once it expires.
+   *
+   *  @param centre The centre of the obstacle.
+   *  @param radius The distance (m) from centre that is blocked, which should include the robot's radius.
+   *  @param lifetime How long (s) the obstacle is kept for.
+   */
+  void addDynamicObstacle(TGlobalOrd centre, double radius, double lifetime);
+
+  /*! @brief Forgets all transient obstacles, before they expire.
+   *
+   */
+  void clearDynamicObstacles();
+
+  /*! @brief Gets the amount of edges blocked by transient obstacles.
+   *
+   *  @return unsigned int - The amount of edges blocked, as of the last search.
+   */
+  unsigned int blockedEdgeCount() const;
+
+  /*! @brief Gets the amount of verticies expanded by replan().
+   *
+   *  @return unsigned long - The amount of verticies expanded since the goal last changed.
+   */
+  unsigned long searchExpansions() const;
+
+  /*! @brief Query the network for paths between many start and goal pairs at once.
+   *
+   *  The queries are answered concurrently on a pool of worker threads, each
+   *  with its own search workspace. The network is not modified.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param pairs The start and goal ordinates of each query.
+   *  @param threads The number of worker threads, 0 to use one per hardware thread.
+   *  @return vector<vector<TGlobalOrd>> - The path for each pair, in the same order
+   *                                      as pairs. A path is empty if none was found.
+   */
+  std::vector<std::vector<TGlobalOrd>> query(cv::Mat &cspace,
+                                             const std::vector<std::pair<TGlobalOrd, TGlobalOrd>> &pairs,
+                                             unsigned int threads = 0);
+
+  /*! @brief Query the network for paths between many start and goal pairs, into caller supplied paths.
+   *
+   *  As above, but each path is written in place. Workers keep their scratch
+   *  space between batches, so once it and paths have grown to fit, a batch
+   *  makes no allocations per query.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param pairs The start and goal ordinates of each query.
+   *  @param paths Resized to pairs, with the path for each pair (empty if none was found).
+   *  @param threads The number of worker threads, 0 to use one per hardware thread.
+   */
+  void query(cv::Mat &cspace, const std::vector<std::pair<TGlobalOrd, TGlobalOrd>> &pairs,
+             std::vector<std::vector<TGlobalOrd>> &paths, unsigned int threads = 0);
+
+  /*! @brief Selects how query() (and build(), which queries first) searches the network.
+   *
+   *  @param method The query method to use, QUERY_DIJKSTRA by default.
+   */
+  void setQueryMethod(TQueryMethod method);
+
+  /*! @brief Preprocesses the network into a contraction hierarchy, see ContractionHierarchy.
+   *
+   *  Queries with QUERY_HIERARCHY then settle only a few hundred verticies,
+   *  even for very large networks. A node joined to the network afterwards by
+   *  a single edge (such as a start or goal) is attached below the hierarchy,
+   *  but any other change to the network makes it stale, and queries search the
+   *  whole network until it is built again. While transient obstacles block
+   *  edges, queries also search the whole network.
+   *
+   *  @return unsigned long - The amount of shortcuts added.
+   */
+  unsigned long buildHierarchy();
+
+  /*! @brief Copies the network, so a hierarchy of it can be built on another thread.
+   *
+   *  Building a hierarchy of a large network takes seconds, which would hold
+   *  up goals if done by buildHierarchy(). The copy can instead be built with
+   *  ContractionHierarchy::build() elsewhere, then given to installHierarchy().
+   *
+   *  @param version Set to the version of the network copied.
+   *  @return Graph - The network.
+   */
+  Graph networkGraph(unsigned long &version) const;
+
+  /*! @brief Replaces the contraction hierarchy with one built from networkGraph().
+   *
+   *  @param hierarchy The hierarchy.
+   *  @param version The version of the network it was built from.
+   *  @return bool - FALSE if the network has changed since, in which case the hierarchy is discarded.
+   */
+  bool installHierarchy(ContractionHierarchy hierarchy, unsigned long version);
+
+  /*! @brief Indicates if the contraction hierarchy matches the network.
+   *
+   *  @return bool - TRUE if the hierarchy was built (or loaded) and the network hasn't changed since.
+   */
+  bool hierarchyCurrent() const;
+
+  /*! @brief Saves the network (and the contraction hierarchy, if current) to a file.
+   *
+   *  A site that doesn't change can then be loaded with loadRoadmap(), rather
+   *  than sampled and preprocessed again on startup. The file is plain text.
+   *
+   *  @param file The path of the file to write.
+   *  @return bool - FALSE if the file couldn't be written.
+   */
+  bool saveRoadmap(const std::string &file) const;
+
+  /*! @brief Replaces the network with one saved by saveRoadmap().
+   *
+   *  The nodes keep their vertex ids, and the overlay and roadmap must be
+   *  redrawn in full. The guards used by CONNECT_VISIBILITY are loaded too,
+   *  while the search made by replan() and transient obstacles are reset.
+   *
+   *  @param file The path of the file to read.
+   *  @return bool - FALSE if the file couldn't be read, in which case the network is unchanged.
+   */
+  bool loadRoadmap(const std::string &file);
+
   /*! @brief Expands the configuration space of a map.
    *
    *  So that we are able to treat the robot as a point in space,
@@ -78,9 +408,33 @@ public:
    *
    *  @param space The space (map) to expand.
    *  @param robotDiameter The diameter of the robot in meters.
+   *
+   *  @note This also finds the known extent of the space (plus a margin), and
+   *        until the reference or map moves, build() only samples and measures
+   *        the space within it. Only the extent is expanded.
    */
   void expandConfigSpace(cv::Mat &space, double robotDiameter);
 
+  /*! @brief Expands the configuration space of a map, around a robot away from the reference.
+   *
+   *  @param space The space (map) to expand.
+   *  @param robotDiameter The diameter of the robot in meters.
+   *  @param robot The global ordinate of the robot, which is kept free.
+   */
+  void expandConfigSpace(cv::Mat &space, double robotDiameter, TGlobalOrd robot);
+
+  /*! @brief Sets the known extent of a cspace that was expanded outside the planner.
+   *
+   *  For a cspace expanded with LocalMap::expandKnownConfigSpace(), e.g. on
+   *  another thread, so build() still only samples within its known extent.
+   *
+   *  @param extent The known extent of the cspace, empty to sample all of it.
+   *
+   *  @note The extent is forgotten when the reference or map changes, so set
+   *        it after those.
+   */
+  void setKnownExtent(const cv::Rect &extent);
+
   /*! @brief Overlays the current state of the PRM unto a colour OgMap.
    *
    *  Not only will this overlay the prm (in blue), but if supplied with
@@ -91,6 +445,50 @@ public:
    */
   void showOverlay(cv::Mat &space, std::vector<TGlobalOrd> path);
 
+  /*! @brief Incrementally draws the PRM onto a persistent overlay layer.
+   *
+   *  Only the nodes and edges added since the last call are drawn, so the
+   *  cost of each call is proportional to the growth of the network rather
+   *  than its size. Removed edges are erased by copying their pixels back
+   *  from base, and the edges near them drawn again. The whole network is
+   *  redrawn after resetOverlay() or a change of reference, origin, map size
+   *  or resolution.
+   *
+   *  @param layer The persistent colour OgMap to draw the PRM on top of.
+   *  @param base The colour OgMap layer was made from, without the PRM.
+   */
+  void updateOverlay(cv::Mat &layer, const cv::Mat &base);
+
+  /*! @brief Marks the overlay layer as stale.
+   *
+   *  The next call to updateOverlay() will draw the whole network. This
+   *  should be called whenever the layer is replaced with a new OgMap.
+   */
+  void resetOverlay();
+
+  /*! @brief Overlays a path unto a colour OgMap.
+   *
+   *  @param space The OgMap to overlay the path on top of.
+   *  @param path The path to overlay (red).
+   */
+  void showPath(cv::Mat &space, std::vector<TGlobalOrd> path);
+
+  /*! @brief Returns the nodes and edges added, and edges removed, since the last call.
+   *
+   *  The first call (and the first call after resetRoadmap()) returns the
+   *  whole network with reset set to TRUE. Otherwise removedEdges should be
+   *  applied before edges, as an edge may be removed and then added again.
+   *
+   *  @return TRoadmap - The changes to the network in global ordinates.
+   */
+  TRoadmap roadmapChanges();
+
+  /*! @brief Marks the roadmap as stale.
+   *
+   *  The next call to roadmapChanges() will return the whole network.
+   */
+  void resetRoadmap();
+
   /*! @brief Sets the reference position of the provided OgMaps.
    *
    *  @param reference The reference to set, this is usually the robot's
@@ -100,10 +498,64 @@ public:
 
   /*! @brief Updates the size of the OgMaps provided.
    *
-   *  @param mapSize The size of the OgMap in meters (square maps only).
+   *  @param mapSize The size of the OgMap in meters (square maps).
    */
   void setMapSize(double mapSize);
 
+  /*! @brief Updates the size of the OgMaps provided.
+   *
+   *  @param width The width (x) of the OgMap in meters.
+   *  @param height The height (y) of the OgMap in meters.
+   */
+  void setMapSize(double width, double height);
+
+  /*! @brief Updates the pixel within the OgMaps that the reference lies at.
+   *
+   *  @param origin The pixel of the reference, by default the centre of the OgMap.
+   */
+  void setOrigin(cv::Point origin);
+
+  /*! @brief Selects how the cspace is walked when connecting nodes.
+   *
+   *  @param backend The collision backend to use, COLLISION_LINE by default.
+   */
+  void setCollisionBackend(TCollisionBackend backend);
+
+  /*! @brief Selects how many neighbours nodes are joined to.
+   *
+   *  With CONNECT_PRM_STAR, k grows with the log of the size of the network
+   *  (as in k-PRM*) and degree is not capped by density. Each node is only
+   *  joined when it is added, so far fewer edges are checked as the network
+   *  grows, while paths still converge towards the shortest.
+   *
+   *  With CONNECT_VISIBILITY, a sample is only kept if no guard can see it
+   *  (becoming a guard), or if it sees guards in two or more components
+   *  (becoming a connector joined to one guard in each). Sampling stops once
+   *  PLANNER_VISIBILITY_MAX_REJECTS samples in a row are rejected, so the
+   *  network stays very small, although its paths are less direct.
+   *
+   *  @param strategy The connection strategy to use, CONNECT_FIXED_K by default.
+   */
+  void setConnectionStrategy(TConnectionStrategy strategy);
+
+  /*! @brief Selects where build() and densify() sample new nodes.
+   *
+   *  The obstacle biased samplers draw a pair of points a normally distributed
+   *  distance apart (see PLANNER_GAUSSIAN_SPREAD) within the expanded cspace. Uniform samples
+   *  rarely land in narrow passages, which these samplers concentrate on, so
+   *  fewer nodes (and rounds of build()) are needed to connect through them.
+   *  PLANNER_UNIFORM_SHARE of samples are still uniform, to cover open space.
+   *
+   *  @param strategy The sampling strategy to use, SAMPLE_UNIFORM by default.
+   */
+  void setSamplingStrategy(TSamplingStrategy strategy);
+
+  /*! @brief Gets the amount of edges that have been collision checked.
+   *
+   *  @return unsigned long - The amount of edges checked while joining nodes.
+   */
+  unsigned long edgeChecks() const;
+
   /*! @brief Updates the resolution of the OgMaps provided.
    *
    *  @param resolution The size of the OgMap in meters.
@@ -118,13 +570,73 @@ public:
    */
   bool ordinateAccessible(cv::Mat &cspace, TGlobalOrd ordinate);
 
+  /*! @brief Creates a cost map penalising proximity to obstacles.
+   *
+   *  @param cspace The configuration space. Must be already expanded.
+   *  @param clearance The distance (m) from obstacles beyond which there is no cost.
+   *  @return Mat - The cost of each pixel (CV_32FC1), in the range [0, 1].
+   */
+  cv::Mat clearanceCost(cv::Mat &cspace, double clearance);
+
+  /*! @brief Sets the cost map used to weight new edges in the network.
+   *
+   *  An edge's weight is its length scaled by (1 + weight * mean cost), where
+   *  the mean cost is taken over the pixels the edge crosses. The search then
+   *  prefers paths through low cost space, such as wide aisles. Edges already
+   *  in the network keep their weight.
+   *
+   *  @param costs The cost of each pixel (CV_32FC1), empty to use pure distance.
+   *  @param weight How strongly cost is penalised relative to distance.
+   */
+  void setCostMap(const cv::Mat &costs, double weight);
+
 private:
   Graph graph_;                             /*!< A graph representation of the roadmap network */
   LocalMap lmap_;                           /*!< An object for interacting with the ogMap provided to this object */
   std::map<vertex, TGlobalOrd> network_;    /*!< A look up table to convert a vertex to coordinate within map */
+  std::map<std::pair<double, double>, vertex> ordinates_; /*!< A look up table to convert a coordinate to a vertex */
+  std::vector<cv::Point> pixels_;           /*!< The position of each vertex within the OgMap, indexed by vertex */
   vertex nextVertexId_;                     /*!< Used for generating unique vertex ids for coordiantes */
   TGlobalOrd reference_;                    /*!< Reference ordinate for the local map, this is usually the robot position */
   unsigned int density_;                    /*!< The density of the prm network (max neighbours a node can have). */
+  cv::Mat costs_;                           /*!< The traversal cost of each pixel, empty if edges are weighted by distance only */
+  double costWeight_;                       /*!< How strongly costs_ is penalised relative to distance */
+  std::shared_ptr<WorkPool> pool_;          /*!< Worker threads for batch queries, created on first use */
+  std::vector<TQueryWorkspace> workspaces_; /*!< A query workspace for each worker in pool_ */
+  TQueryWorkspace workspace_;               /*!< The query workspace for single queries (and detours) */
+  ContractionHierarchy hierarchy_;          /*!< The contraction hierarchy of the network, for QUERY_HIERARCHY */
+  bool hierarchyCurrent_;                   /*!< TRUE if hierarchy_ matches the network */
+  TQueryMethod queryMethod_;                /*!< How query() searches the network */
+  unsigned long networkVersion_;            /*!< Incremented whenever an edge is added, removed or reweighted */
+  TIncrementalSearch search_;               /*!< The search made by replan(), repaired as the network changes */
+  std::vector<TDynamicObstacle> obstacles_; /*!< Transient obstacles that haven't expired */
+  edgeSet blocked_;                         /*!< Edges blocked by obstacles_, left out of searches */
+  std::map<std::pair<int, int>, edgeSet> edgeBuckets_; /*!< The edges spanning each square of the world grid, see indexEdge() */
+  bool blockedStale_;                       /*!< TRUE if obstacles_ changed since blocked_ was found */
+  cv::Rect extent_;                         /*!< The known region of the last expanded cspace, empty if unknown */
+  TConnectionStrategy connection_;          /*!< How many neighbours nodes are joined to */
+  TSamplingStrategy sampling_;              /*!< Where new nodes are sampled */
+  vertex joined_;                           /*!< Verticies from this id on have not been joined by joinNetwork() */
+  unsigned long edgeChecks_;                /*!< The amount of edges collision checked while joining nodes */
+  std::vector<vertex> components_;          /*!< Disjoint sets of connected verticies (union-find parents), indexed by vertex */
+  std::vector<vertex> guards_;              /*!< Verticies kept by CONNECT_VISIBILITY as guards */
+
+  TNetworkChanges overlayChanges_;          /*!< Changes to the network since the last updateOverlay() */
+  TNetworkChanges roadmapChanges_;          /*!< Changes to the network since the last roadmapChanges() */
+
+  /*! @brief Query the network for a path between start and goal, using the given workspace.
+   *
+   *  This only reads the network, so may be called concurrently with different workspaces.
+   *  Edges in blocked_ are left out, refreshBlocked() must be called first.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param start The starting ordinate.
+   *  @param goal  The goal ordiante to reach from start.
+   *  @param workspace The scratch space for the search and the path.
+   *  @param path Replaced with the path between start and goal, empty if none was found.
+   */
+  void query(cv::Mat &cspace, TGlobalOrd start, TGlobalOrd goal,
+             TQueryWorkspace &workspace, std::vector<TGlobalOrd> &path) const;
 
   /*! @brief Optimises a path between two points in a config space.
    *
@@ -137,8 +649,36 @@ private:
    *  @param cspace The configuration space to find direct access within.
    *  @param path An ordered representation of the path, where the first element
    *              is the start, and the end element is the goal.
+   *  @return vector<TGlobalOrd> - The optimised path.
+   */
+  std::vector<TGlobalOrd> optimisePath(cv::Mat &cspace, const std::vector<vertex> &path) const;
+
+  /*! @brief Optimises a path, into caller supplied buffers.
+   *
+   *  @param cspace The configuration space to find direct access within.
+   *  @param path An ordered representation of the path, from start to goal.
+   *  @param pathWeight Scratch space for the weight along path to each vertex.
+   *  @param optPath Replaced with the optimised path.
+   */
+  void optimisePath(cv::Mat &cspace, const std::vector<vertex> &path,
+                    std::vector<weight> &pathWeight, std::vector<TGlobalOrd> &optPath) const;
+
+  /*! @brief Determines if two nodes can be connected, and the weight of the edge.
+   *
+   *  @param cspace The configuration space.
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @param w Set to the weight of an edge between v and u, if they can be connected.
+   *  @return TRUE - If there is nothing blocking the path between v and u.
+   */
+  bool edgeWeight(cv::Mat &cspace, vertex v, vertex u, weight &w) const;
+
+  /*! @brief Indicates if edges within cspace are weighted by the cost map.
+   *
+   *  @param cspace The configuration space.
+   *  @return TRUE - If a cost map matching cspace has been set.
    */
-  std::vector<TGlobalOrd> optimisePath(cv::Mat &cspace, std::vector<TGlobalOrd> path);
+  bool usingCosts(cv::Mat &cspace) const;
 
   /*! @brief Embeds a node in the prm network.
    *
@@ -157,12 +697,114 @@ private:
 
   /*! @brief Joins node configurations to eachother within the network.
    *
+   *  With CONNECT_PRM_STAR, only the nodes added since the last join are
+   *  joined, to connectionK() of their neighbours rather than k.
    *
    *  @param cspace The configuration space to embed the nodes in.
    *  @param k The amount of neighbours to attempt to connect too (for each node).
    */
   void joinNetwork(cv::Mat &cspace, unsigned int k);
 
+  /*! @brief Joins the nodes added since the last join to their neighbours.
+   *
+   *  Older nodes only gain edges to the new ones, so unlike joinNetwork()
+   *  the network isn't walked node by node.
+   *
+   *  @param cspace The configuration space to embed the nodes in.
+   *  @param k The amount of neighbours to attempt to connect too (for each new node).
+   */
+  void joinNewNodes(cv::Mat &cspace, unsigned int k);
+
+  /*! @brief Calculates the amount of neighbours to join nodes to with CONNECT_PRM_STAR.
+   *
+   *  @return unsigned int - ceil(PLANNER_PRM_STAR_K * log(n)) for a network of n nodes, at least 1.
+   */
+  unsigned int connectionK() const;
+
+  /*! @brief Keeps a sample as a Visibility-PRM guard or connector.
+   *
+   *  @param cspace The configuration space. Must be already expanded.
+   *  @param ordinate The sample, which must be accessible.
+   *  @return bool - TRUE if the sample was added to the network.
+   */
+  bool addVisibleNode(cv::Mat &cspace, TGlobalOrd ordinate);
+
+  /*! @brief Moves a uniform sample towards obstacles, as the sampling strategy dictates.
+   *
+   *  @param cspace The configuration space. Must be already expanded.
+   *  @param generator The random generator to draw the second point of the pair with.
+   *  @param ordinate The uniform sample, set to the biased sample if one is found.
+   *  @return bool - TRUE if a biased sample was found, otherwise it should be discarded.
+   */
+  bool biasSample(cv::Mat &cspace, std::default_random_engine &generator, TGlobalOrd &ordinate);
+
+  /*! @brief Expires transient obstacles, and finds the edges blocked by the rest.
+   *
+   *  Edges that become blocked or unblocked are repaired in search_.
+   */
+  void refreshBlocked();
+
+  /*! @brief Checks if the straight line between two ordinates is free within cspace.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param o1 The first ordinate.
+   *  @param o2 The second ordinate.
+   *  @return bool - TRUE if the line is free of obstacles (and transient obstacles),
+   *                 or either ordinate is outside cspace so can't be checked.
+   */
+  bool segmentFree(cv::Mat &cspace, TGlobalOrd o1, TGlobalOrd o2);
+
+  /*! @brief Finds a free detour between two waypoints through the network.
+   *
+   *  A waypoint that isn't a node (e.g. the robot's position) is joined to its
+   *  nearest visible node for the search, rather than being added to the network.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param from The waypoint to leave the path from.
+   *  @param to The waypoint to rejoin the path at.
+   *  @return vector<TGlobalOrd> - The detour, including from and to, empty if none was found.
+   */
+  std::vector<TGlobalOrd> detour(cv::Mat &cspace, TGlobalOrd from, TGlobalOrd to);
+
+  /*! @brief Finds the node an ordinate is at, or the nearest node it can reach directly.
+   *
+   *  @param cspace The map configuration space. Must be already expanded.
+   *  @param ord The ordinate to find a node for.
+   *  @param v Set to the node found.
+   *  @return bool - TRUE if a node was found.
+   */
+  bool nearestNode(cv::Mat &cspace, TGlobalOrd ord, vertex &v);
+
+  /*! @brief Returns the region of cspace around the line between two ordinates.
+   *
+   *  @param o1 The first ordinate.
+   *  @param o2 The second ordinate.
+   *  @param margin The margin (m) around the line.
+   *  @return Rect - The bounding box of the line plus margin, in pixels.
+   */
+  cv::Rect regionAround(TGlobalOrd o1, TGlobalOrd o2, double margin);
+
+  /*! @brief Checks if the straight line between two ordinates passes through a transient obstacle.
+   *
+   *  @param o1 The first ordinate.
+   *  @param o2 The second ordinate.
+   *  @return bool - TRUE if the line is blocked.
+   */
+  bool crossesObstacle(TGlobalOrd o1, TGlobalOrd o2) const;
+
+  /*! @brief Finds the connected component a vertex belongs to.
+   *
+   *  @param v The vertex.
+   *  @return vertex - The vertex representing v's component.
+   */
+  vertex component(vertex v);
+
+  /*! @brief Finds the connected components again from the network's edges.
+   *
+   *  Needed after edges are removed, as components are otherwise only merged.
+   */
+  void rebuildComponents();
+
 
   /*! @brief Returns a representation of the internal PRM.
    *
@@ -172,6 +814,82 @@ private:
    */
   std::vector<std::pair<cv::Point, cv::Point>> composePRM();
 
+  /*! @brief Returns a representation of the PRM added since the last updateOverlay().
+   *
+   *  @return vector<<Point, Point>> - A vector of pairs of points in the same form
+   *                                   as composePRM().
+   */
+  std::vector<std::pair<cv::Point, cv::Point>> composeNewPRM();
+
+  /*! @brief Erases the edges removed since the last updateOverlay() from the overlay layer.
+   *
+   *  @param layer The persistent colour OgMap the PRM is drawn on.
+   *  @param base The colour OgMap layer was made from, without the PRM.
+   */
+  void eraseRemovedEdges(cv::Mat &layer, const cv::Mat &base);
+
+  /*! @brief Records a vertex in all tracked network changes.
+   *
+   *  @param v The vertex that was added.
+   */
+  void trackVertex(vertex v);
+
+  /*! @brief Records an edge in all tracked network changes.
+   *
+   *  @param v The first vertex of the edge.
+   *  @param u The second vertex of the edge.
+   */
+  void trackEdge(vertex v, vertex u);
+
+  /*! @brief Records a removed edge in all tracked network changes.
+   *
+   *  @param v The first vertex of the edge.
+   *  @param u The second vertex of the edge.
+   */
+  void trackRemovedEdge(vertex v, vertex u);
+
+  /*! @brief Finds the edges whose pixels may lie within a region.
+   *
+   *  Only the squares of the world grid under region are visited (see indexEdge()).
+   *
+   *  @param region The region of the OgMap.
+   *  @param found The edges are added to this, each as (lower vertex, higher vertex).
+   */
+  void edgesWithin(cv::Rect region, edgeSet &found) const;
+
+  /*! @brief Adds an edge to (or removes it from) the squares of the world grid it spans.
+   *
+   *  The squares are in global ordinates, so the index is kept as the reference moves.
+   *
+   *  @param v The first vertex of the edge.
+   *  @param u The second vertex of the edge.
+   *  @param add TRUE to add the edge, FALSE to remove it.
+   */
+  void indexEdge(vertex v, vertex u, bool add);
+
+  /*! @brief Finds the squares of the world grid a box of global ordinates spans.
+   *
+   *  @param o1 A corner of the box.
+   *  @param o2 The opposite corner of the box.
+   *  @return Rect - The first square (x, y) and the amount of squares across and down.
+   */
+  cv::Rect bucketRange(TGlobalOrd o1, TGlobalOrd o2) const;
+
+  /*! @brief Marks changes as stale, as they will be consumed in full.
+   *
+   *  @param changes The changes to reset.
+   */
+  static void resetChanges(TNetworkChanges &changes);
+
+  /*! @brief Adds an edge between two nodes in the network.
+   *
+   *  @param v The first vertex.
+   *  @param u The second vertex.
+   *  @param w The weight of the edge.
+   *  @return TRUE - If the edge was added to the graph.
+   */
+  bool connect(vertex v, vertex u, weight w);
+
   /*! @brief Converts a path of globalOrds to OgMap points.
    *
    *  @param path The path of ordiantes to convert.
@@ -179,12 +897,38 @@ private:
    */
   std::vector<cv::Point> toPointPath(std::vector<TGlobalOrd> path);
 
-  /*! @brief Converts a path of verticies to Global ords.
+  /*! @brief Returns the cached position of a vertex within the OgMap.
+   *
+   *  @param v The vertex, which must exist within the network.
+   *  @return Point - The vertex's pixel position.
+   */
+  cv::Point pixel(vertex v) const { return pixels_[v]; }
+
+  /*! @brief Recalculates the cached OgMap position of every vertex.
+   *
+   *  Must be called whenever the reference, map size or resolution changes.
+   */
+  void refreshPixels();
+
+  /*! @brief Adds randomly sampled nodes to the network (without joining them).
+   *
+   *  Samples are drawn from the free space within samplingRegion(), and must
+   *  be separated from the existing nodes as required by LD-PRM.
    *
-   *  @param path The path of verticies to convert.
-   *  @return vector<TGlobalOrd> - The converted path of Verticies.
+   *  @param cspace The configuration space. Must be already expanded.
+   *  @param nodes The amount of nodes to add.
+   *  @return unsigned int - The amount of nodes added, fewer than requested
+   *                         if PLANNER_MAX_SAMPLE_ATTEMPTS is reached.
+   */
+  unsigned int sampleNodes(cv::Mat &cspace, unsigned int nodes);
+
+  /*! @brief The region of the cspace that build() samples within.
+   *
+   *  @param cspace The configuration space.
+   *  @return Rect - The known extent found by expandConfigSpace(), or the
+   *                 whole cspace if it isn't known.
    */
-  std::vector<TGlobalOrd> toOrdPath(std::vector<vertex> path);
+  cv::Rect samplingRegion(const cv::Mat &cspace) const;
 
   /*! @brief Returns a list of neighbours for the node.
    *
@@ -196,9 +940,9 @@ private:
    *  @param node The node to get neighbours for.
    *  @param shouldConnect An extra qualifier for a neighbour. TRUE if you
    *                       want to actually connect to it.
-   *  @return vector<TGlobalOrd> - A list of neighbours
+   *  @return vector<vertex> - A list of neighbours
    */
-  std::vector<TGlobalOrd> getNeighbours(cv::Mat &cspace, vertex node, bool shouldConnect);
+  std::vector<vertex> getNeighbours(cv::Mat &cspace, vertex node, bool shouldConnect);
 
   /*! @brief Get the vertex corresponding to a global ordiante.
    *
@@ -215,7 +959,7 @@ private:
    *  @param ord The ordiante to find or add.
    *  @return TRUE - If the ordiante exists.
    */
-  bool existsAsVertex(TGlobalOrd ord);
+  bool existsAsVertex(TGlobalOrd ord) const;
 
   /*! @brief Finds the vertex corresponding to an ordiante.
    *
@@ -223,7 +967,7 @@ private:
    *  @param v A reference to put the found vertex into.
    *  @return TRUE - If the ordiante was found within the network_.
    */
-  bool lookup(TGlobalOrd ord, vertex &v);
+  bool lookup(TGlobalOrd ord, vertex &v) const;
 
   /*! @brief Returns the next unique vertex id within the graph.
    *
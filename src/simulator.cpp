@@ -5,8 +5,9 @@
  *  Using an internal LD-PRM path planner, this class listens
  *  for goal requests on /request_goal then builds a PRM network
  *  within a supplied configuration space.
- *  The PRM network is sent as an image to /prm, and the path waypoints
- *  between robot and goal are sent as a PoseArray to /path.
+ *  The PRM network is sent as an image to /prm and as a vector Roadmap to
+ *  /roadmap, and the path waypoints between robot and goal are sent as a
+ *  PoseArray to /path.
  *
  *  @author arosspope
  *  @date 12-10-2017
@@ -17,62 +18,160 @@
 #include "geometry_msgs/PoseArray.h"
 #include "nav_msgs/Odometry.h"
 #include "prm_sim/RequestGoal.h"
+#include "prm_sim/Roadmap.h"
 
 #include <image_transport/image_transport.h>
 #include <cv_bridge/cv_bridge.h>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <future>
 
 namespace enc = sensor_msgs::image_encodings;
 
 static const double DEF_ROBOT_DIAMETER = 0.2; /*!< Default robot diameter is 0.2m */
 static const int MAX_BUILD_ROUNDS = 5;        /*!< The max amount of times the builder is allowed to plan a path towards a goal */
+static const double DEF_OVERLAY_RATE = 2.0;   /*!< Default max rate (Hz) the overlay is published at */
+static const double DEF_OVERLAY_SCALE = 1.0;  /*!< Default scale of the published overlay (1.0 is full resolution) */
+static const double DEF_CLEARANCE = 0.0;      /*!< Default distance (m) from obstacles that is penalised, 0 disables cost weighting */
+static const double DEF_CLEARANCE_WEIGHT = 1.0; /*!< Default penalty for travelling close to obstacles, relative to distance */
+static const int DEF_PREBUILD_NODES = 0;      /*!< Default size of the network built before goals arrive, 0 disables pre-building */
+static const unsigned int PREBUILD_BATCH = 50; /*!< The amount of nodes pre-built between checking for a goal */
+static const double IDLE_PERIOD = 0.01;       /*!< Time (s) the planner sleeps when there is nothing to do */
+static const double DEF_DYNAMIC_RADIUS = 0.5;   /*!< Default radius (m) of a transient obstacle */
+static const double DEF_DYNAMIC_LIFETIME = 2.0; /*!< Default time (s) a transient obstacle blocks the network */
 
 Simulator::Simulator(ros::NodeHandle nh, TWorldDataBuffer &buffer):
-  buffer_(buffer), nh_(nh), it_(nh)
+  Simulator(nh, ros::NodeHandle("~"), buffer)
+{}
+
+Simulator::Simulator(ros::NodeHandle nh, ros::NodeHandle pn, TWorldDataBuffer &buffer):
+  buffer_(buffer), nh_(nh), it_(nh), hasMapInfo_(false),
+  prepMap_(PLANNER_DEF_MAP_SIZE, PLANNER_DEF_MAP_RES)
 {
   pathPub_      = nh_.advertise<geometry_msgs::PoseArray>("path", 1);
-  overlayPub_   = it_.advertise("prm", 1);
+  roadmapPub_   = nh_.advertise<prm_sim::Roadmap>("roadmap", 100,
+                                                  boost::bind(&Simulator::roadmapConnect, this, _1));
+  overlayPub_   = it_.advertise("prm", 1, true); //latched, as the overlay is only sent on change
   reqGoal_      = nh_.advertiseService("request_goal", &Simulator::requestGoal, this);
+  reqRoadmap_   = nh_.advertiseService("request_roadmap", &Simulator::requestRoadmap, this);
+  obstaclesSub_ = nh_.subscribe("dynamic_obstacles", 10, &Simulator::obstaclesCallback, this);
 
   //Get parameters from command line
-  ros::NodeHandle pn("~");
+  int density, prebuildNodes;
   double mapSize;
-  double mapResolution;
-  int density;
+  std::string connection, sampling;
 
   pn.param<double>("map_size", mapSize, PLANNER_DEF_MAP_SIZE);
-  pn.param<double>("resolution", mapResolution, PLANNER_DEF_MAP_RES);
+  pn.param<double>("map_width", mapWidth_, mapSize);
+  pn.param<double>("map_height", mapHeight_, mapSize);
+  pn.param<double>("resolution", mapResolution_, PLANNER_DEF_MAP_RES);
   pn.param<int>("density", density, PLANNER_DEF_DENSITY);
   pn.param<double>("robot_diameter", robotDiameter_, DEF_ROBOT_DIAMETER);
+  pn.param<double>("overlay_rate", overlayRate_, DEF_OVERLAY_RATE);
+  pn.param<double>("overlay_scale", overlayScale_, DEF_OVERLAY_SCALE);
+  pn.param<double>("clearance", clearance_, DEF_CLEARANCE);
+  pn.param<double>("clearance_weight", clearanceWeight_, DEF_CLEARANCE_WEIGHT);
+  pn.param<int>("prebuild_nodes", prebuildNodes, DEF_PREBUILD_NODES);
+  pn.param<std::string>("connection", connection, "fixed");
+  pn.param<std::string>("sampling", sampling, "uniform");
+  pn.param<bool>("skeleton", skeleton_, false);
+  pn.param<bool>("replan", replan_, false);
+  pn.param<double>("dynamic_radius", dynamicRadius_, DEF_DYNAMIC_RADIUS);
+  pn.param<double>("dynamic_lifetime", dynamicLifetime_, DEF_DYNAMIC_LIFETIME);
+  pn.param<bool>("monitor_path", monitorPath_, false);
+  pn.param<bool>("hierarchy", hierarchy_, false);
+  pn.param<std::string>("roadmap_file", roadmapFile_, "");
+
+  if(overlayRate_ <= 0){
+    ROS_WARN("Invalid overlay_rate {%.1f}, using default", overlayRate_);
+    overlayRate_ = DEF_OVERLAY_RATE;
+  }
+
+  if(overlayScale_ <= 0 || overlayScale_ > 1){
+    ROS_WARN("Invalid overlay_scale {%.2f}, using default", overlayScale_);
+    overlayScale_ = DEF_OVERLAY_SCALE;
+  }
 
-  ROS_INFO("Init with: map_size={%.1f} resolution={%.1f} robot_diameter={%.1f} density={%d}",
-           mapSize, mapResolution, robotDiameter_, density);
+  if(prebuildNodes < 0){
+    ROS_WARN("Invalid prebuild_nodes {%d}, pre-building is disabled", prebuildNodes);
+    prebuildNodes = 0;
+  }
+  prebuildNodes_ = prebuildNodes;
+
+  ROS_INFO("Init with: map_size={%.1fx%.1f} resolution={%.1f} robot_diameter={%.1f} density={%d}",
+           mapWidth_, mapHeight_, mapResolution_, robotDiameter_, density);
+  ROS_INFO("Overlay with: overlay_rate={%.1f} overlay_scale={%.2f}", overlayRate_, overlayScale_);
+  ROS_INFO("Costs with: clearance={%.2f} clearance_weight={%.1f}", clearance_, clearanceWeight_);
+  ROS_INFO("Pre-build with: prebuild_nodes={%u}", prebuildNodes_);
+
+  planner_ = PrmPlanner(mapWidth_, mapHeight_, mapResolution_, density);
+  prepMap_ = LocalMap(mapWidth_, mapHeight_, mapResolution_);
+
+  if(connection == "prm_star"){
+    ROS_INFO("Joining nodes with k-PRM*, density is ignored");
+    planner_.setConnectionStrategy(CONNECT_PRM_STAR);
+  } else if(connection == "visibility"){
+    ROS_INFO("Joining nodes with Visibility-PRM, density is ignored");
+    planner_.setConnectionStrategy(CONNECT_VISIBILITY);
+  } else if(connection != "fixed"){
+    ROS_WARN("Invalid connection {%s}, using fixed", connection.c_str());
+  }
 
-  planner_ = PrmPlanner(mapSize, mapResolution, density);
+  if(sampling == "gaussian"){
+    planner_.setSamplingStrategy(SAMPLE_GAUSSIAN);
+  } else if(sampling == "bridge"){
+    planner_.setSamplingStrategy(SAMPLE_BRIDGE);
+  } else if(sampling != "uniform"){
+    ROS_WARN("Invalid sampling {%s}, using uniform", sampling.c_str());
+  }
+
+  if(hierarchy_){
+    planner_.setQueryMethod(QUERY_HIERARCHY);
+  }
+
+  //A saved network of the site saves building (and preprocessing) it again
+  if(!roadmapFile_.empty()){
+    if(planner_.loadRoadmap(roadmapFile_)){
+      ROS_INFO("Loaded %u nodes from roadmap_file {%s}", planner_.nodeCount(), roadmapFile_.c_str());
+    } else {
+      ROS_WARN("Could not load roadmap_file {%s}, building a new network", roadmapFile_.c_str());
+    }
+  }
 }
 
 void Simulator::overlayThread(){
   cv::Mat msg;
+  ros::Rate rate(overlayRate_);
 
-  while(ros::ok()){
-    if(overlayContainer_.dirty){
+  while(ok()){
+    //Only send the overlay when it has changed and someone is listening. If
+    //nobody is, the overlay stays dirty so the latest is sent once they are
+    if(overlayContainer_.dirty && overlayPub_.getNumSubscribers() > 0){
       //We make a copy of the prmOverlay,
       //otherwise we retain a reference to it which can change
       //We only want to see change when dirty is set to true
       overlayContainer_.access.lock();
 
-      overlayContainer_.data.copyTo(msg);
+      if(overlayScale_ < 1.0){
+        cv::resize(overlayContainer_.data, msg, cv::Size(), overlayScale_, overlayScale_, cv::INTER_AREA);
+      } else {
+        overlayContainer_.data.copyTo(msg);
+      }
       overlayContainer_.dirty = false;
 
       overlayContainer_.access.unlock();
       ROS_INFO("Updating PRM overlay...");
+
+      if(!msg.empty())
+        sendOverlay(msg);
     }
 
-    if(!msg.empty())
-      sendOverlay(msg);
+    rate.sleep();
   }
 }
 
@@ -80,10 +179,21 @@ void Simulator::plannerThread() {
   //Wait until some data has arrived in the world information buffer
   ROS_INFO("Waiting to receive world data...");
   waitForWorldData();
+
+  //The first OgMap must also have made it through the cspace stage
+  while(ok() && !updateWorld()){
+    ros::Duration(IDLE_PERIOD).sleep();
+  }
   ROS_INFO("Ready to recieve requests...");
 
-  while(ros::ok()){
-    //Only plan if a new goal has been recieved
+  while(ok()){
+    //A new roadmap subscriber needs the whole network, even when idle
+    if(roadmapResync_){
+      sendRoadmap();
+    }
+
+    //Only plan if a new goal has been recieved, otherwise use the idle
+    //time to build the network ahead of the next goal
     if(goalContainer_.dirty)
     {
       //Get the new goal
@@ -93,14 +203,7 @@ void Simulator::plannerThread() {
       goalContainer_.access.unlock();
 
       //Recieve new information from the world buffer
-      consumeWorldData(cspace_, robotPos_);
-
-      //Update the reference for the localMap
-      TGlobalOrd robotOrd = {robotPos_.position.x, robotPos_.position.y};
-      ROS_INFO("Setting reference: {%.1f, %.1f}", robotOrd.x, robotOrd.y);
-      planner_.setReference(robotOrd);
-
-      if(cspace_.empty()){
+      if(!updateWorld()){
         //Something has gone wrong during image transmission,
         //skip execution for this goal and hope new data has arived
         //on the next go around
@@ -108,13 +211,7 @@ void Simulator::plannerThread() {
         continue;
       }
 
-      //Copy to the prm overlay before expanding config space
-      overlayContainer_.access.lock();
-      cv::cvtColor(cspace_, overlayContainer_.data, CV_GRAY2BGR);
-      overlayContainer_.access.unlock();
-
-      //Expand the configuration space
-      planner_.expandConfigSpace(cspace_, robotDiameter_);
+      TGlobalOrd robotOrd = {robotPos_.position.x, robotPos_.position.y};
 
       //Validate both ordinates
       if(!planner_.ordinateAccessible(cspace_, robotOrd)){
@@ -135,19 +232,18 @@ void Simulator::plannerThread() {
 
       std::vector<TGlobalOrd> path;
       int round(0);
+
+      //Repairing the last search is cheap, so is tried before building
+      if(replan_){
+        path = planner_.replan(cspace_, robotOrd, currentGoal);
+      }
+
       //While we haven't found a path and the rounds a less than the max and ros is okay,
       //build more nodes and try to find a path
-      while(path.size() == 0 && round < MAX_BUILD_ROUNDS && ros::ok()){
+      while(path.size() == 0 && round < MAX_BUILD_ROUNDS && ok()){
         ROS_INFO("  Building nodes...");
         path = planner_.build(cspace_, robotOrd, currentGoal);
-
-        //Update PRM overlay with network and potentially path
-        overlayContainer_.access.lock();
-
-        planner_.showOverlay(overlayContainer_.data, path);
-        overlayContainer_.dirty = true;
-
-        overlayContainer_.access.unlock();
+        publishNetwork(path);
         round++;
       }
 
@@ -157,14 +253,263 @@ void Simulator::plannerThread() {
       } else {
         ROS_WARN("  Could not find path. Perhaps choose a closer goal?");
       }
+
+      path_ = path;
+      pathGoal_ = currentGoal;
+    } else if(!monitorPath() && !prebuild() && !preprocess()){
+      //Nothing to do until a goal or new world data arrives
+      ros::Duration(IDLE_PERIOD).sleep();
+    }
+  }
+}
+
+void Simulator::cspaceThread(){
+  TPreparedSpace back;
+
+  waitForWorldData();
+
+  while(ok()){
+    if(!consumeOgMap(back)){
+      ros::Duration(IDLE_PERIOD).sleep();
+      continue;
+    }
+
+    if(back.cspace.empty()){
+      //Something has gone wrong during image transmission, wait for the next
+      ROS_ERROR("Empty OgMap");
+      continue;
+    }
+
+    prepareSpace(back);
+
+    //Swap the back buffer in, anything the planner hadn't taken yet is stale
+    preparedContainer_.access.lock();
+    std::swap(preparedContainer_.data, back);
+    preparedContainer_.dirty = true;
+    preparedContainer_.access.unlock();
+  }
+}
+
+void Simulator::prepareSpace(TPreparedSpace &space){
+  //Copy to the layer before expanding config space, the whole
+  //network must be redrawn on top of the new OgMap
+  cv::cvtColor(space.cspace, space.layer, CV_GRAY2BGR);
+
+  //The stage's own LocalMap is used, as the planner's may be in use
+  prepMap_.setResolution(space.resolution);
+  prepMap_.setMapSize(space.width, space.height);
+
+  //The network keeps every node, so a skeleton is only added once per static map
+  bool newSkeleton = false;
+  if(skeleton_){
+    newSkeleton = newStaticMap(space);
+  }
+
+  //Expand the configuration space, keeping the robot free
+  cv::Point robot = prepMap_.convertToPoint(space.reference, space.robot);
+  space.extent = prepMap_.expandKnownConfigSpace(space.cspace, robot, robotDiameter_, PLANNER_EXTENT_MARGIN);
+
+  //Penalise new edges that pass close to obstacles
+  if(clearance_ > 0){
+    space.costs = prepMap_.clearanceCost(space.cspace, clearance_);
+  } else {
+    space.costs.release();
+  }
+
+  //Thinning is most of the work of a skeleton roadmap, so it is done here too
+  if(newSkeleton){
+    space.skeleton = prepMap_.skeleton(space.cspace, space.extent);
+  } else {
+    space.skeleton.release();
+  }
+}
+
+bool Simulator::newStaticMap(const TPreparedSpace &space){
+  //A robot-centred OgMap moves with the robot, so every one would add a skeleton
+  if(!hasMapInfo_){
+    ROS_WARN_ONCE("The skeleton is only added for OgMaps read from an occupancy grid");
+    return false;
+  }
+
+  if(!skeletonMap_.empty() && skeletonReference_ == space.reference &&
+     LocalMap::changedRegion(skeletonMap_, space.cspace).area() == 0){
+    return false;
+  }
+
+  skeletonMap_ = space.cspace.clone();
+  skeletonReference_ = space.reference;
+  return true;
+}
+
+bool Simulator::updateWorld(){
+  consumePose(robotPos_);
+  consumeObstacles();
+
+  if(!preparedContainer_.dirty){
+    return !cspace_.empty(); //No new OgMap, the last one is still ready
+  }
+
+  //Take the front buffer, leaving nothing behind for the stage to write into
+  preparedContainer_.access.lock();
+  TPreparedSpace space = preparedContainer_.data;
+  preparedContainer_.data = TPreparedSpace();
+  preparedContainer_.dirty = false;
+  preparedContainer_.access.unlock();
+  worldChanged_ = true;
+
+  //Only the pixels that differ from the last OgMap can change the edges. One that has
+  //moved is compared where it overlaps the last, with the pixels it reveals
+  bool moved = !(cspaceReference_ == space.reference);
+  bool resized = cspace_.empty();
+  TGlobalOrd lastReference = cspaceReference_;
+  cspaceReference_ = space.reference;
+
+  if(space.width != mapWidth_ || space.height != mapHeight_ ||
+     space.resolution != mapResolution_){
+    resized = true;
+    mapWidth_ = space.width;
+    mapHeight_ = space.height;
+    mapResolution_ = space.resolution;
+
+    ROS_INFO("Map is now: map_size={%.1fx%.1f} resolution={%.2f}", mapWidth_, mapHeight_, mapResolution_);
+    planner_.setResolution(mapResolution_);
+    planner_.setMapSize(mapWidth_, mapHeight_);
+  }
+
+  ROS_INFO("Setting reference: {%.1f, %.1f}", space.reference.x, space.reference.y);
+  planner_.setReference(space.reference);
+  planner_.setKnownExtent(space.extent);
+
+  std::vector<cv::Rect> changed(1, space.extent);
+  if(replan_ && !resized){
+    //Where the last OgMap's pixels lie in this one (y grows downwards)
+    cv::Point shift((int)std::round((lastReference.x - space.reference.x) / mapResolution_),
+                    (int)std::round((space.reference.y - lastReference.y) / mapResolution_));
+    changed = LocalMap::changedRegions(cspace_, space.cspace, shift, moved ? 1 : 0);
+
+    //The cost of a pixel depends on the obstacles within clearance of it
+    if(clearance_ > 0){
+      int pixels = std::ceil(clearance_ / mapResolution_);
+      for(auto &region: changed){
+        region = cv::Rect(region.x - pixels, region.y - pixels,
+                          region.width + 2 * pixels, region.height + 2 * pixels);
+      }
+    }
+  }
+
+  cspace_ = space.cspace;
+  cspaceStamp_ = space.stamp;
+  prmBase_ = space.layer;
+  prmLayer_ = space.layer.clone();
+  planner_.resetOverlay();
+
+  if(clearance_ > 0){
+    planner_.setCostMap(space.costs, clearanceWeight_);
+  }
+
+  //Edges the new OgMap blocks are dropped, so a replan routes around them
+  if(replan_){
+    unsigned int removed = planner_.updateEdges(cspace_, changed);
+    if(removed > 0){
+      ROS_INFO("Removed %u blocked edges", removed);
     }
   }
+
+  if(!space.skeleton.empty()){
+    unsigned int nodes = planner_.buildSkeleton(cspace_, space.skeleton);
+    ROS_INFO("Added skeleton: %u nodes", nodes);
+  }
+
+  return true;
+}
+
+bool Simulator::prebuild(){
+  if(prebuildNodes_ == 0){
+    return false;
+  }
+
+  //Keep building on the latest OgMap, so the network is ready for its goals
+  if(!updateWorld() || planner_.nodeCount() >= prebuildNodes_){
+    return false;
+  }
+
+  //Only a small batch is built, so a goal arriving meanwhile isn't held up for long
+  if(planner_.densify(cspace_, PREBUILD_BATCH) == 0){
+    return false;
+  }
+
+  ROS_DEBUG("Pre-built network to %u nodes", planner_.nodeCount());
+  publishNetwork(std::vector<TGlobalOrd>());
+  return true;
+}
+
+bool Simulator::preprocess(){
+  if(!hierarchy_){
+    return false;
+  }
+
+  //A finished build is only used if no goal has changed the network meanwhile
+  if(hierarchyBuild_.valid()){
+    if(hierarchyBuild_.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+      return false;
+    }
+
+    if(!planner_.installHierarchy(hierarchyBuild_.get(), hierarchyVersion_)){
+      ROS_DEBUG("Network changed while building the contraction hierarchy, building again");
+      return false;
+    }
+
+    ROS_INFO("Built contraction hierarchy of %u nodes", planner_.nodeCount());
+    if(!roadmapFile_.empty() && !planner_.saveRoadmap(roadmapFile_)){
+      ROS_WARN("Could not save roadmap_file {%s}", roadmapFile_.c_str());
+    }
+
+    return true;
+  }
+
+  //Only a finished network is preprocessed, it is done again if a goal changes it
+  if(planner_.hierarchyCurrent() || planner_.nodeCount() == 0 || planner_.nodeCount() < prebuildNodes_){
+    return false;
+  }
+
+  //Built on a copy of the network, so goals aren't held up while it runs
+  hierarchyBuild_ = std::async(std::launch::async, [](const Graph &graph){
+    ContractionHierarchy hierarchy;
+    hierarchy.build(graph);
+    return hierarchy;
+  }, planner_.networkGraph(hierarchyVersion_));
+
+  return false;
+}
+
+void Simulator::publishNetwork(const std::vector<TGlobalOrd> &path){
+  //Draw only the new part of the network onto the prm layer, then
+  //composite the path on top of a copy so the layer stays path free
+  planner_.updateOverlay(prmLayer_, prmBase_);
+
+  overlayContainer_.access.lock();
+
+  prmLayer_.copyTo(overlayContainer_.data);
+  planner_.showPath(overlayContainer_.data, path);
+  overlayContainer_.dirty = true;
+
+  overlayContainer_.access.unlock();
+
+  sendRoadmap();
+}
+
+void Simulator::stop(){
+  running_ = false;
+}
+
+bool Simulator::ok() const{
+  return running_ && ros::ok();
 }
 
 void Simulator::waitForWorldData(){
   //We must wait until information about the world has been recieved
   //so that we can begin building the prm
-  while(ros::ok()){
+  while(ok()){
     int mapSz, poseSz;
     buffer_.access.lock();
     mapSz = buffer_.ogMapDeq.size();
@@ -194,17 +539,151 @@ bool Simulator::requestGoal(prm_sim::RequestGoal::Request &req, prm_sim::Request
   return true;
 }
 
-void Simulator::consumeWorldData(cv::Mat &ogMap, geometry_msgs::Pose &robotPos){
-  //Get information about the world if available
+bool Simulator::requestRoadmap(prm_sim::RequestRoadmap::Request &req, prm_sim::RequestRoadmap::Response &res)
+{
+  //Called from the spinner, so leave the planner to the planner thread
+  ROS_INFO("Roadmap resync requested");
+  roadmapResync_ = true;
+  res.ack = true;
+
+  return true;
+}
+
+bool Simulator::monitorPath(){
+  if(!monitorPath_ || path_.empty()){
+    return false;
+  }
+
+  if(!updateWorld() || !worldChanged_){
+    return false; //Nothing new to check the path against
+  }
+  worldChanged_ = false;
+
+  //Drop the waypoints the robot has passed, up to the start of the segment it is closest
+  //to, and start the path from the robot so a resent path doesn't lead it back
+  TGlobalOrd robot = {robotPos_.position.x, robotPos_.position.y};
+  unsigned int closest = 0;
+  double closestDistance = std::numeric_limits<double>::infinity();
+  for(unsigned int i = 0; i + 1 < path_.size(); i++){
+    double d = PrmPlanner::distanceToSegment(robot, path_[i], path_[i + 1]);
+    if(d < closestDistance){
+      closestDistance = d;
+      closest = i;
+    }
+  }
+  if(path_.size() > 1){
+    path_.erase(path_.begin(), path_.begin() + closest + 1);
+  }
+  path_.insert(path_.begin(), robot);
+
+  switch(planner_.checkPath(cspace_, path_)){
+  case PATH_VALID:
+    return false;
+  case PATH_REPAIRED:
+    ROS_INFO("Repaired path around new obstacles");
+    sendPath(path_);
+    publishNetwork(path_);
+    return true;
+  case PATH_BLOCKED:
+  default:
+    ROS_WARN("Path is blocked, planning again to {%.1f, %.1f}", pathGoal_.x, pathGoal_.y);
+
+    //A goal requested meanwhile takes priority
+    goalContainer_.access.lock();
+    if(!goalContainer_.dirty){
+      goalContainer_.data = pathGoal_;
+      goalContainer_.dirty = true;
+    }
+    goalContainer_.access.unlock();
+
+    path_.clear();
+    return true;
+  }
+}
+
+void Simulator::obstaclesCallback(const geometry_msgs::PoseArrayConstPtr &msg){
+  //Each message is the whole obstacle set, so it replaces any the planner hasn't taken
+  std::vector<TGlobalOrd> obstacles;
+  for(auto const &pose: msg->poses){
+    obstacles.push_back(TGlobalOrd{pose.position.x, pose.position.y});
+  }
+
+  obstacleContainer_.access.lock();
+  obstacleContainer_.data.swap(obstacles);
+  obstacleContainer_.dirty = true;
+
+  obstacleContainer_.access.unlock();
+}
+
+void Simulator::consumeObstacles(){
+  if(!obstacleContainer_.dirty){
+    return;
+  }
+
+  std::vector<TGlobalOrd> obstacles;
+  obstacleContainer_.access.lock();
+  obstacles.swap(obstacleContainer_.data);
+  obstacleContainer_.dirty = false;
+  obstacleContainer_.access.unlock();
+
+  worldChanged_ = true;
+
+  //The obstacles of the last message are replaced, even if this one is empty.
+  //The robot is a point in the cspace, so each obstacle grows by its radius
+  planner_.clearDynamicObstacles();
+  for(auto const &centre: obstacles){
+    planner_.addDynamicObstacle(centre, dynamicRadius_ + robotDiameter_ / 2, dynamicLifetime_);
+  }
+}
+
+bool Simulator::consumeOgMap(TPreparedSpace &space){
   buffer_.access.lock();
-  if(buffer_.ogMapDeq.size() > 0){
-    ogMap = buffer_.ogMapDeq.front();
-    buffer_.ogMapDeq.pop_front();
+  if(buffer_.ogMapDeq.size() == 0){
+    buffer_.access.unlock();
+    return false;
+  }
+
+  space.cspace = buffer_.ogMapDeq.front();
+  space.stamp = buffer_.ogMapStampDeq.front();
+  buffer_.ogMapDeq.pop_front();
+  buffer_.ogMapStampDeq.pop_front();
+
+  if(buffer_.mapInfoDeq.size() > 0){
+    mapInfo_ = buffer_.mapInfoDeq.front();
+    hasMapInfo_ = true;
+    buffer_.mapInfoDeq.pop_front();
   }
 
+  //The latest pose is left for the planner to consume
+  geometry_msgs::Pose pose = buffer_.poseDeq.back();
+  buffer_.access.unlock();
+
+  //An OgMap read from an occupancy grid is centred on the grid rather than the robot
+  space.robot.x = pose.position.x;
+  space.robot.y = pose.position.y;
+  if(hasMapInfo_){
+    space.reference = mapInfo_.centre;
+    space.width = mapInfo_.width;
+    space.height = mapInfo_.height;
+    space.resolution = mapInfo_.resolution;
+  } else {
+    //Only changed by the planner for OgMaps with a TMapInfo
+    space.reference = space.robot;
+    space.width = mapWidth_;
+    space.height = mapHeight_;
+    space.resolution = mapResolution_;
+  }
+
+  return true;
+}
+
+void Simulator::consumePose(geometry_msgs::Pose &robotPos){
+  buffer_.access.lock();
   if(buffer_.poseDeq.size() > 0){
     robotPos = buffer_.poseDeq.back();
-    buffer_.poseDeq.pop_front();
+
+    //Keep the latest, so the cspace stage can still centre OgMaps on it
+    buffer_.poseDeq.erase(buffer_.poseDeq.begin(), buffer_.poseDeq.end() - 1);
   }
   buffer_.access.unlock();
 }
@@ -215,6 +694,55 @@ void Simulator::sendOverlay(cv::Mat &overlay){
   overlayPub_.publish(msg);
 }
 
+void Simulator::roadmapConnect(const ros::SingleSubscriberPublisher &pub){
+  //Called from the spinner, so leave the planner to the planner thread
+  roadmapResync_ = true;
+}
+
+void Simulator::sendRoadmap(){
+  if(roadmapPub_.getNumSubscribers() == 0){
+    //Nobody is listening, don't accumulate changes for them
+    planner_.resetRoadmap();
+    return;
+  }
+
+  if(roadmapResync_.exchange(false)){
+    planner_.resetRoadmap();
+  }
+
+  TRoadmap roadmap = planner_.roadmapChanges();
+  if(!roadmap.reset && roadmap.nodes.empty() && roadmap.edges.empty() && roadmap.removedEdges.empty()){
+    return; //Nothing has changed
+  }
+
+  prm_sim::Roadmap msg;
+  msg.header.stamp = ros::Time::now();
+  msg.seq = roadmapSeq_++;
+  msg.reset = roadmap.reset;
+
+  for(auto const &node: roadmap.nodes){
+    geometry_msgs::Point p;
+    p.x = node.second.x;
+    p.y = node.second.y;
+    p.z = robotPos_.position.z; //Just send the z value of the original robot position
+
+    msg.ids.push_back(node.first);
+    msg.nodes.push_back(p);
+  }
+
+  for(auto const &e: roadmap.edges){
+    msg.edges.push_back(e.first);
+    msg.edges.push_back(e.second);
+  }
+
+  for(auto const &e: roadmap.removedEdges){
+    msg.removed_edges.push_back(e.first);
+    msg.removed_edges.push_back(e.second);
+  }
+
+  roadmapPub_.publish(msg);
+}
+
 void Simulator::sendPath(std::vector<TGlobalOrd> path){
   if(path.size() > 0){
     //Send the waypoints
@@ -228,6 +756,8 @@ void Simulator::sendPath(std::vector<TGlobalOrd> path){
       posePath.poses.push_back(w);
     }
 
+    //Stamped with the OgMap it was planned on, so the latency from map to path can be measured
+    posePath.header.stamp = cspaceStamp_;
     pathPub_.publish(posePath);
     ROS_INFO("Sent path information...");
   }
@@ -5,8 +5,9 @@
  *  Using an internal LD-PRM path planner, this class listens
  *  for goal requests on /request_goal then builds a PRM network
  *  within a supplied configuration space.
- *  The PRM network is sent as an image to /prm, and the path waypoints
- *  between robot and goal are sent as a PoseArray to /path.
+ *  The PRM network is sent as an image to /prm and as a vector Roadmap to
+ *  /roadmap, and the path waypoints between robot and goal are sent as a
+ *  PoseArray to /path.
  *
  *  @author arosspope
  *  @date 12-10-2017
@@ -16,10 +17,13 @@
 
 #include <opencv2/opencv.hpp>
 #include <atomic>
+#include <future>
 #include <image_transport/image_transport.h>
 
 #include "ros/ros.h"
+#include "geometry_msgs/PoseArray.h"
 #include "prm_sim/RequestGoal.h"
+#include "prm_sim/RequestRoadmap.h"
 #include "prmplanner.h"
 #include "types.h"
 
@@ -30,6 +34,20 @@ struct TDataContainer { /*!< A container to control access to data that is acces
   std::atomic<bool> dirty{false}; /*!< Atomic boolean to indicate if the data has been modified */
 };
 
+struct TPreparedSpace { /*!< An OgMap made ready for planning by the cspace stage */
+  cv::Mat cspace;         /*!< The expanded configuration space (greyscale) */
+  cv::Mat layer;          /*!< The OgMap before expansion, in colour, for the prm to be drawn on */
+  cv::Mat costs;          /*!< The clearance cost of each pixel, empty if clearance is disabled */
+  cv::Mat skeleton;       /*!< The skeleton of cspace's free space, empty if the skeleton isn't used */
+  cv::Rect extent;        /*!< The known extent of cspace */
+  TGlobalOrd reference;   /*!< The reference ordinate of the OgMap */
+  TGlobalOrd robot;       /*!< The robot position when the OgMap was consumed */
+  ros::Time stamp;        /*!< The stamp of the OgMap */
+  double width;           /*!< The width (x) of the OgMap (m) */
+  double height;          /*!< The height (y) of the OgMap (m) */
+  double resolution;      /*!< The resolution of the OgMap */
+};
+
 class Simulator
 {
 public:
@@ -41,19 +59,53 @@ public:
    */
   Simulator(ros::NodeHandle nh, TWorldDataBuffer &buffer);
 
+  /*! @brief Constructor for Simulator, reading parameters from a given namespace.
+   *
+   *  @param nh The handle of the ros node using this class
+   *  @param pn The handle to read parameters from, e.g. a nodelet's private handle
+   *  @param buffer A reference to a shared world data buffer. This buffer should
+   *                be populated by another thread.
+   */
+  Simulator(ros::NodeHandle nh, ros::NodeHandle pn, TWorldDataBuffer &buffer);
+
+  /*! @brief Asks plannerThread and overlayThread to return.
+   *
+   *  The threads otherwise run until ros is shutdown, which doesn't happen
+   *  when a nodelet is unloaded from a running manager.
+   */
+  void stop();
+
   /*! @brief Creates a path between robot and goal using PRM planner.
    *
    *  This thread waits on a goal then attempts to plan a path between
    *  the robot's last known position and the goal. Will send waypoints
    *  of the path between start and goal to topic /path.
    *
+   *  Whilst there is no goal, the network is densified in small batches on
+   *  the latest OgMap (up to the prebuild_nodes parameter), so most goals
+   *  can be answered without building. Once it is built, the network is
+   *  preprocessed into a contraction hierarchy (if the hierarchy parameter is
+   *  set) and saved to roadmap_file.
+   *
    *  @note Whilst the planner is building the network, multiple goal requests
    *        are ignored.
    */
   void plannerThread(void);
 
+  /*! @brief Prepares each new OgMap for the planner.
+   *
+   *  The latest OgMap is expanded (and costed) in a back buffer, which is
+   *  then swapped for the planner to take. Goals are then planned without
+   *  waiting for the OgMap to be preprocessed.
+   */
+  void cspaceThread();
+
   /*! @brief Sends an overlay of the prm network and path to topic /prm.
    *
+   *  The overlay is only sent when it has changed and there are subscribers,
+   *  at no more than the rate given by the overlay_rate parameter. It may be
+   *  downscaled with the overlay_scale parameter. If compressed_image_transport
+   *  is installed, a compressed version is also available on /prm/compressed.
    */
   void overlayThread();
 
@@ -61,18 +113,55 @@ private:
   ros::NodeHandle nh_;                      /*!< The handle of the ros node using this class */
   image_transport::ImageTransport it_;      /*!< Transport mechanism for images */
   ros::ServiceServer reqGoal_;              /*!< Advertises a service '/request_goal' to set the goal */
+  ros::ServiceServer reqRoadmap_;           /*!< Advertises a service '/request_roadmap' to resend the whole roadmap */
   image_transport::Publisher overlayPub_;   /*!< Publishes an overlay of the prm on top of the OgMap to /prm */
   ros::Publisher pathPub_;                  /*!< Publishes the path between robot and goal on /path */
+  ros::Publisher roadmapPub_;               /*!< Publishes changes to the prm network on /roadmap */
+  ros::Subscriber obstaclesSub_;            /*!< Subscribes to transient obstacles on /dynamic_obstacles */
+  std::atomic<bool> roadmapResync_{false};  /*!< Set when a new subscriber (or a client that lost a Roadmap) needs the whole roadmap */
+  uint32_t roadmapSeq_{0};                  /*!< The seq of the next Roadmap sent */
+  std::atomic<bool> running_{true};         /*!< Cleared by stop() to end the threads */
 
   TWorldDataBuffer &buffer_;                /*!< A shared global structure that gets updated with world information */
   PrmPlanner planner_;                      /*!< The LD-PRM planner for path finding */
 
   double robotDiameter_;                    /*!< Diameter of the robot in meters */
+  double overlayRate_;                      /*!< The max rate (Hz) the overlay is published at */
+  double overlayScale_;                     /*!< The scale (0, 1] the overlay is published at */
+  double clearance_;                        /*!< Distance (m) from obstacles that is penalised, 0 if disabled */
+  double clearanceWeight_;                  /*!< Penalty for travelling close to obstacles, relative to distance */
+  unsigned int prebuildNodes_;              /*!< The size of the network to build before goals arrive, 0 if disabled */
+  bool skeleton_;                           /*!< TRUE if the skeleton of each new static map is added to the network */
+  bool replan_;                             /*!< TRUE if blocked edges are removed, and goals first repair the last search */
+  double dynamicRadius_;                    /*!< The radius (m) of each transient obstacle, not including the robot */
+  double dynamicLifetime_;                  /*!< How long (s) each transient obstacle blocks the network */
+  bool monitorPath_;                        /*!< TRUE if the last path sent is checked against new world data */
+  bool hierarchy_;                          /*!< TRUE if goals are queried with a contraction hierarchy of the network */
+  std::string roadmapFile_;                 /*!< The file the network is loaded from and saved to, empty if disabled */
+  std::future<ContractionHierarchy> hierarchyBuild_; /*!< The contraction hierarchy being built, invalid if none */
+  unsigned long hierarchyVersion_{0};       /*!< The version of the network hierarchyBuild_ is built from */
+  bool worldChanged_{false};                /*!< TRUE if an OgMap or obstacle arrived since the path was last checked */
+  std::vector<TGlobalOrd> path_;            /*!< The last path sent, starting from the robot rather than the waypoints it has passed */
+  TGlobalOrd pathGoal_;                     /*!< The goal of path_ */
   cv::Mat cspace_;                          /*!< The current configuration space (greyscale) */
+  TGlobalOrd cspaceReference_;              /*!< The reference ordinate of cspace_ */
+  ros::Time cspaceStamp_;                   /*!< The stamp of the OgMap cspace_ was made from, sent with each path */
+  cv::Mat prmLayer_;                        /*!< The OgMap with the prm drawn on top, updated incrementally each build round */
+  cv::Mat prmBase_;                         /*!< The OgMap prmLayer_ was made from, used to erase removed edges */
   geometry_msgs::Pose robotPos_;            /*!< The current robot position */
+  double mapWidth_;                         /*!< The width (x) of the OgMaps (m) the planner is using */
+  double mapHeight_;                        /*!< The height (y) of the OgMaps (m) the planner is using */
+  double mapResolution_;                    /*!< The resolution of the OgMaps the planner is using */
+  TMapInfo mapInfo_;                        /*!< Where the latest OgMap lies, if it was read from an occupancy grid (cspace stage only) */
+  bool hasMapInfo_;                         /*!< TRUE if mapInfo_ is known, otherwise the OgMap is centred on the robot (cspace stage only) */
+  LocalMap prepMap_;                        /*!< Used by the cspace stage to expand OgMaps (cspace stage only) */
+  cv::Mat skeletonMap_;                     /*!< The OgMap (before expansion) the last skeleton was found in (cspace stage only) */
+  TGlobalOrd skeletonReference_;            /*!< The reference ordinate of skeletonMap_ (cspace stage only) */
 
   TDataContainer<TGlobalOrd> goalContainer_;  /*!< The current goal for the robot to reach (shared between threads/callbacks) */
   TDataContainer<cv::Mat> overlayContainer_;  /*!< An image of the last known prm/path overlayed onto the cspace (shared between threads) */
+  TDataContainer<TPreparedSpace> preparedContainer_; /*!< The latest OgMap prepared by the cspace stage, dirty until the planner takes it */
+  TDataContainer<std::vector<TGlobalOrd>> obstacleContainer_; /*!< Transient obstacles received since the planner last took them */
 
   /*! @brief Callback function for service /request_goal.
    *
@@ -86,12 +175,92 @@ private:
    */
   bool requestGoal(prm_sim::RequestGoal::Request &req, prm_sim::RequestGoal::Response &res);
 
-  /*! @brief Consumes data from the shared WorldInfoBuffer.
+  /*! @brief Callback for transient obstacles on /dynamic_obstacles.
+   *
+   *  Each message is the current set of obstacles, replacing the last. The
+   *  position of each pose is passed to the planner thread, which blocks the
+   *  network around them (see PrmPlanner::addDynamicObstacle).
+   *
+   *  @param msg The centres of the obstacles.
+   */
+  void obstaclesCallback(const geometry_msgs::PoseArrayConstPtr &msg);
+
+  /*! @brief Passes the transient obstacles received since the last call to the planner.
+   *
+   */
+  void consumeObstacles();
+
+  /*! @brief Consumes the next OgMap from the shared WorldInfoBuffer.
+   *
+   *  If the OgMap is described by a TMapInfo, mapInfo_ is also updated.
+   *  Otherwise the OgMap is centred on the latest robot position.
+   *
+   *  @param space Set to the new OgMap and where it lies, not yet expanded.
+   *  @return bool - TRUE if a new ogMap was consumed.
+   */
+  bool consumeOgMap(TPreparedSpace &space);
+
+  /*! @brief Consumes the latest robot position from the shared WorldInfoBuffer.
    *
-   *  @param ogMap A reference to a variable to hold the new ogMap.
    *  @param robotPos A reference to a variable to hold the new robot position.
    */
-  void consumeWorldData(cv::Mat &ogMap, geometry_msgs::Pose &robotPos);
+  void consumePose(geometry_msgs::Pose &robotPos);
+
+  /*! @brief Expands an OgMap and creates its cost map and prm layer.
+   *
+   *  @param space The OgMap to prepare, from consumeOgMap().
+   */
+  void prepareSpace(TPreparedSpace &space);
+
+  /*! @brief Checks if an OgMap is a static map that hasn't had its skeleton added yet.
+   *
+   *  @param space The OgMap being prepared, before it is expanded.
+   *  @return bool - TRUE if it was read from an occupancy grid and differs
+   *                 from the last one the skeleton was added for.
+   */
+  bool newStaticMap(const TPreparedSpace &space);
+
+  /*! @brief Takes the latest prepared OgMap and robot position for the planner.
+   *
+   *  A newly prepared OgMap updates the planner's reference and replaces
+   *  cspace_ and the prm layer. Otherwise only the robot position is updated.
+   *
+   *  @return bool - TRUE if cspace_ is ready to plan in.
+   */
+  bool updateWorld();
+
+  /*! @brief Adds a batch of nodes to the network while there is no goal.
+   *
+   *  @return bool - TRUE if nodes were added, FALSE if there was nothing to do.
+   */
+  bool prebuild();
+
+  /*! @brief Preprocesses a built network into a contraction hierarchy while there is no goal.
+   *
+   *  The hierarchy is built on another thread from a copy of the network, so
+   *  a goal arriving meanwhile is answered straight away. Once built, it is
+   *  used if the network hasn't changed since (otherwise it is built again),
+   *  and the network is saved to roadmapFile_, if set.
+   *
+   *  @return bool - TRUE if a hierarchy was installed, FALSE if there was nothing to do.
+   */
+  bool preprocess();
+
+  /*! @brief Checks the last path sent against new world data, repairing or replacing it.
+   *
+   *  Waypoints the robot has passed are replaced by its current position, then
+   *  the rest of the path is checked (see PrmPlanner::checkPath). A repaired path is sent again, and
+   *  if it can't be repaired its goal is requested again.
+   *
+   *  @return bool - TRUE if the path was changed, FALSE if there was nothing to do.
+   */
+  bool monitorPath();
+
+  /*! @brief Draws the latest changes to the network and a path, then sends them.
+   *
+   *  @param path The path to show on the overlay, may be empty.
+   */
+  void publishNetwork(const std::vector<TGlobalOrd> &path);
 
   /*! @brief Send an overlay of the prm and path to the /prm topic.
    *
@@ -99,6 +268,34 @@ private:
    */
   void sendOverlay(cv::Mat &overlay);
 
+  /*! @brief Callback for a new subscriber to /roadmap.
+   *
+   *  Requests that the whole roadmap is sent on the next sendRoadmap().
+   *
+   *  @param pub The publisher for the new subscriber.
+   */
+  void roadmapConnect(const ros::SingleSubscriberPublisher &pub);
+
+  /*! @brief Callback function for service /request_roadmap.
+   *
+   *  A client that finds a gap in the seq of the Roadmaps it received has
+   *  missed some changes, so this requests that the whole roadmap is sent
+   *  (with reset set) on the next sendRoadmap().
+   *
+   *  @param req The request, which is empty.
+   *  @param res The response sent back. Always TRUE.
+   *  @return TRUE - Always true as there is no failure case.
+   */
+  bool requestRoadmap(prm_sim::RequestRoadmap::Request &req, prm_sim::RequestRoadmap::Response &res);
+
+  /*! @brief Sends the changes to the prm network to the /roadmap topic.
+   *
+   *  Only the nodes and edges added since the last call are sent, unless
+   *  a new subscriber has connected (or /request_roadmap was called), in
+   *  which case the whole network is sent. Each message has the next seq.
+   */
+  void sendRoadmap();
+
   /*! @brief Sends a series of waypoint poses to the /path topic.
    *
    *  @param path The path to send.
@@ -110,6 +307,12 @@ private:
    *  @note This waits for data in both the ogMapDeq and poseDeq.
    */
   void waitForWorldData();
+
+  /*! @brief Indicates if the threads should keep running.
+   *
+   *  @return bool - TRUE if ros is okay and stop() hasn't been called.
+   */
+  bool ok() const;
 };
 
 #endif // SIMULATOR_H
@@ -9,6 +9,7 @@
 #define TYPES
 
 #include "nav_msgs/Odometry.h"
+#include <ros/time.h>
 #include <opencv2/opencv.hpp>
 #include <thread>
 #include <deque>
@@ -24,10 +25,20 @@ struct TGlobalOrd
   }
 };
 
+struct TMapInfo /*!< Describes where an OgMap lies in the world */
+{
+  double resolution;  /*!< Size of each pixel (m) */
+  double width;       /*!< Width (x) of the map (m) */
+  double height;      /*!< Height (y) of the map (m) */
+  TGlobalOrd centre;  /*!< The global ordinate at the centre of the map */
+};
+
 struct TWorldDataBuffer /*!< Used as a container for map information */
 {
   std::deque<geometry_msgs::Pose> poseDeq;  /*!< A queue of robot poses */
   std::deque<cv::Mat> ogMapDeq;             /*!< A queue of OgMaps */
+  std::deque<ros::Time> ogMapStampDeq;      /*!< The stamp of each OgMap, in step with ogMapDeq */
+  std::deque<TMapInfo> mapInfoDeq;          /*!< A queue describing each OgMap, only when read from an occupancy grid */
   std::mutex access;                        /*!< Mutex to control access to the buffer */
 };
 
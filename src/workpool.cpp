@@ -0,0 +1,98 @@
+/*! @file
+ *
+ *  @brief A pool of worker threads for running batches of independent tasks.
+ *
+ *  The workers are started once and reused for every batch. Within a batch,
+ *  idle workers take the next unclaimed task, so a worker that draws a few
+ *  long tasks doesn't hold up the others.
+ *
+ *  @author agent
+ *  @date 17-10-2026
+*/
+#include "workpool.h"
+
+#include <algorithm>
+
+WorkPool::WorkPool(unsigned int workers):
+  tasks_(0), next_(0), batch_(0), active_(0), stop_(false)
+{
+  if(workers == 0){
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for(unsigned int i = 0; i < workers; i++){
+    workers_.push_back(std::thread(&WorkPool::work, this, i));
+  }
+}
+
+WorkPool::~WorkPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(access_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+
+  for(auto &t: workers_){
+    t.join();
+  }
+}
+
+void WorkPool::run(size_t tasks, job fn)
+{
+  if(tasks == 0){
+    return;
+  }
+
+  std::lock_guard<std::mutex> batch(running_);
+  std::unique_lock<std::mutex> lock(access_);
+  job_ = fn;
+  tasks_ = tasks;
+  next_ = 0;
+  active_ = workers_.size();
+  batch_++;
+  wake_.notify_all();
+
+  //Wait until every worker has run out of tasks
+  done_.wait(lock, [this]{ return active_ == 0; });
+  job_ = nullptr;
+}
+
+unsigned int WorkPool::size() const
+{
+  return workers_.size();
+}
+
+void WorkPool::work(unsigned int worker)
+{
+  unsigned long lastBatch = 0;
+
+  while(true){
+    job fn;
+    size_t tasks;
+
+    {
+      std::unique_lock<std::mutex> lock(access_);
+      wake_.wait(lock, [this, lastBatch]{ return stop_ || batch_ != lastBatch; });
+
+      if(stop_){
+        return;
+      }
+
+      lastBatch = batch_;
+      fn = job_;
+      tasks = tasks_;
+    }
+
+    //Claim tasks until there are none left in this batch
+    for(size_t task = next_++; task < tasks; task = next_++){
+      fn(task, worker);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(access_);
+      active_--;
+    }
+    done_.notify_one();
+  }
+}
@@ -0,0 +1,79 @@
+/*! @file
+ *
+ *  @brief A pool of worker threads for running batches of independent tasks.
+ *
+ *  The workers are started once and reused for every batch. Within a batch,
+ *  idle workers take the next unclaimed task, so a worker that draws a few
+ *  long tasks doesn't hold up the others.
+ *
+ *  @author agent
+ *  @date 17-10-2026
+*/
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkPool
+{
+public:
+  typedef std::function<void(size_t task, unsigned int worker)> job; /*!< Runs one task, on the given worker */
+
+  /*! @brief Constructor for WorkPool.
+   *
+   *  @param workers The number of worker threads, 0 to use one per hardware thread.
+   */
+  WorkPool(unsigned int workers);
+
+  /*! @brief Stops and joins all worker threads.
+   */
+  ~WorkPool();
+
+  WorkPool(const WorkPool &) = delete;
+  WorkPool &operator=(const WorkPool &) = delete;
+
+  /*! @brief Runs a batch of tasks on the pool, blocking until all are complete.
+   *
+   *  Each task is run exactly once. The worker index passed to the job is
+   *  in the range [0, size()), and a worker runs one task at a time, so it
+   *  may be used to index per-worker scratch space. If another batch is
+   *  running, this waits for it to complete first.
+   *
+   *  @param tasks The number of tasks in the batch.
+   *  @param fn The job to run for each task.
+   */
+  void run(size_t tasks, job fn);
+
+  /*! @brief Returns the number of worker threads.
+   *
+   *  @return unsigned int - The number of workers.
+   */
+  unsigned int size() const;
+
+private:
+  std::vector<std::thread> workers_;  /*!< The worker threads */
+  std::mutex running_;                /*!< Held for the duration of a batch, so batches run one at a time */
+  std::mutex access_;                 /*!< Protects the batch state below */
+  std::condition_variable wake_;      /*!< Signalled when a new batch starts, or the pool stops */
+  std::condition_variable done_;      /*!< Signalled when a worker finishes its part of a batch */
+
+  job job_;                           /*!< The job for the current batch */
+  size_t tasks_;                      /*!< The number of tasks in the current batch */
+  std::atomic<size_t> next_;          /*!< The next unclaimed task in the current batch */
+  unsigned long batch_;               /*!< Incremented for every batch, so workers can tell a new batch has started */
+  unsigned int active_;               /*!< The number of workers still working on the current batch */
+  bool stop_;                         /*!< TRUE when the workers should exit */
+
+  /*! @brief The loop run by each worker thread.
+   *
+   *  @param worker The index of this worker.
+   */
+  void work(unsigned int worker);
+};
+
+#endif // WORKPOOL_H
@@ -4,11 +4,14 @@
  *
  *  Using roscore to connect to other ros nodes, this object
  *  obtains information from /odom (robot's pose), and /map_image/full (OgMap).
+ *  Alternatively, the OgMap may be read straight from /map (an occupancy grid),
+ *  which avoids converting and transmitting it as an image.
  *
  *  @author arosspope
  *  @date 12-10-2017
 */
 #include "worldretrieve.h"
+#include "localmap.h"
 #include "sensor_msgs/image_encodings.h"
 #include "nav_msgs/Odometry.h"
 
@@ -20,13 +23,32 @@
 
 namespace enc = sensor_msgs::image_encodings;
 
+static const int DEF_FREE_THRESHOLD = 0;        /*!< Default highest occupancy that is free, as in prm_sim_image_node */
+static const int DEF_OCCUPIED_THRESHOLD = 100;  /*!< Default lowest occupancy that is occupied, as in prm_sim_image_node */
+static const int MIN_GRID_SIZE = 3;             /*!< Grids smaller than this (cells) in either dimension are ignored */
+
 WorldRetrieve::WorldRetrieve(ros::NodeHandle nh, TWorldDataBuffer &buffer):
+  WorldRetrieve(nh, ros::NodeHandle("~"), buffer)
+{}
+
+WorldRetrieve::WorldRetrieve(ros::NodeHandle nh, ros::NodeHandle pn, TWorldDataBuffer &buffer):
   buffer_(buffer), nh_(nh)
 {
   odom_ = nh_.subscribe("odom", 1000, &WorldRetrieve::odomCallBack, this);
 
-  image_transport::ImageTransport it(nh);
-  ogmap_ = it.subscribe("map_image/full", 1, &WorldRetrieve::ogMapCallBack, this);
+  bool occupancyGrid;
+  pn.param<bool>("occupancy_grid", occupancyGrid, false);
+  pn.param<int>("free_threshold", freeThreshold_, DEF_FREE_THRESHOLD);
+  pn.param<int>("occupied_threshold", occupiedThreshold_, DEF_OCCUPIED_THRESHOLD);
+
+  if(occupancyGrid){
+    ROS_INFO("Reading OgMaps from occupancy grids: free_threshold={%d} occupied_threshold={%d}",
+             freeThreshold_, occupiedThreshold_);
+    grid_ = nh_.subscribe("map", 1, &WorldRetrieve::gridCallBack, this);
+  } else {
+    image_transport::ImageTransport it(nh);
+    ogmap_ = it.subscribe("map_image/full", 1, &WorldRetrieve::ogMapCallBack, this);
+  }
 }
 
 void WorldRetrieve::odomCallBack(const nav_msgs::OdometryConstPtr &msg){
@@ -78,11 +100,53 @@ void WorldRetrieve::ogMapCallBack(const sensor_msgs::ImageConstPtr &msg){
   buffer_.access.lock();
 
   buffer_.ogMapDeq.push_back(cvPtr->image);
+  buffer_.ogMapStampDeq.push_back(msg->header.stamp);
 
   //To keep both the ogmap and pose buffer in lock-step, we remove
   //old data from the queue
   if(buffer_.ogMapDeq.size() > 1){
     buffer_.ogMapDeq.pop_front();
+    buffer_.ogMapStampDeq.pop_front();
+  }
+
+  buffer_.access.unlock();
+}
+
+void WorldRetrieve::gridCallBack(const nav_msgs::OccupancyGridConstPtr &msg){
+  int width = msg->info.width;
+  int height = msg->info.height;
+
+  if(width < MIN_GRID_SIZE || height < MIN_GRID_SIZE || msg->data.size() < (size_t)width * height){
+    ROS_ERROR("Invalid occupancy grid: %dx%d with %zu cells", width, height, msg->data.size());
+    return;
+  }
+
+  //The grid is read in place, the only copy made is the converted OgMap
+  cv::Mat ogMap = LocalMap::fromOccupancyGrid(msg->data.data(), width, height,
+                                              freeThreshold_, occupiedThreshold_);
+
+  TMapInfo info;
+  info.resolution = msg->info.resolution;
+  info.width = width * info.resolution;
+  info.height = height * info.resolution;
+  info.centre.x = msg->info.origin.position.x + info.width / 2;
+  info.centre.y = msg->info.origin.position.y + info.height / 2;
+
+  buffer_.access.lock();
+
+  buffer_.ogMapDeq.push_back(ogMap);
+  buffer_.ogMapStampDeq.push_back(msg->header.stamp);
+  buffer_.mapInfoDeq.push_back(info);
+
+  //To keep both the ogmap and pose buffer in lock-step, we remove
+  //old data from the queue
+  if(buffer_.ogMapDeq.size() > 1){
+    buffer_.ogMapDeq.pop_front();
+    buffer_.ogMapStampDeq.pop_front();
+  }
+
+  if(buffer_.mapInfoDeq.size() > 1){
+    buffer_.mapInfoDeq.pop_front();
   }
 
   buffer_.access.unlock();
@@ -4,6 +4,8 @@
  *
  *  Using roscore to connect to other ros nodes, this object
  *  obtains information from /odom (robot's pose), and /map_image/full (OgMap).
+ *  Alternatively, the OgMap may be read straight from /map (an occupancy grid),
+ *  which avoids converting and transmitting it as an image.
  *
  *  @author arosspope
  *  @date 12-10-2017
@@ -14,6 +16,7 @@
 #include <image_transport/image_transport.h>
 #include "ros/ros.h"
 #include "nav_msgs/Odometry.h"
+#include "nav_msgs/OccupancyGrid.h"
 #include "sensor_msgs/image_encodings.h"
 #include "types.h"
 
@@ -27,11 +30,22 @@ public:
    */
   WorldRetrieve(ros::NodeHandle nh, TWorldDataBuffer &buffer);
 
+  /*! @brief Constructor for WorldRetrieve, reading parameters from a given namespace.
+   *
+   *  @param nh The handle of the ros node using this class
+   *  @param pn The handle to read parameters from, e.g. a nodelet's private handle
+   *  @param buffer A reference to a shared world data buffer
+   */
+  WorldRetrieve(ros::NodeHandle nh, ros::NodeHandle pn, TWorldDataBuffer &buffer);
+
 private:
   ros::NodeHandle nh_;                /*!< The handle of the ros node using this class */
   ros::Subscriber odom_;              /*!< A subscription to the /odom topic */
   image_transport::Subscriber ogmap_; /*!< A subscription to the /map_image/full topic */
+  ros::Subscriber grid_;              /*!< A subscription to the /map topic, if reading occupancy grids */
   TWorldDataBuffer &buffer_;          /*!< A shared global structure to update with world information */
+  int freeThreshold_;                 /*!< The highest occupancy in a grid that is free space */
+  int occupiedThreshold_;             /*!< The lowest occupancy in a grid that is occupied space */
 
   /*! @brief Call back for receiving robot poses.
    *
@@ -57,6 +71,19 @@ private:
    */
   void ogMapCallBack(const sensor_msgs::ImageConstPtr &msg);
 
+  /*! @brief Call back for receiving occupancy grids.
+   *
+   *  Upon triger, the grid is converted to an OgMap and put into the
+   *  internal buffer, along with its resolution and where it lies in the
+   *  world. As with images, old data in the buffer will be overwritten if
+   *  not consumed in a timely manner.
+   *
+   *  @param msg A ros msg containing the occupancy grid.
+   *
+   *  @note Rotated grids are not supported, the orientation of the origin is ignored.
+   */
+  void gridCallBack(const nav_msgs::OccupancyGridConstPtr &msg);
+
 };
 
 #endif // WORLDRETRIEVE_H
@@ -0,0 +1,491 @@
+/*! @file
+ *
+ *  @brief Micro benchmarks for the planner's hot paths.
+ *
+ *  These are not run as part of the unit tests. Build them with
+ *  'catkin_make tests' and run './devel/lib/prm_sim/prm_sim-bench' in
+ *  catkin_ws. Pass '-n <iterations>' to change how many times each case
+ *  is repeated (default is 200000). The roadmap cases compare the
+ *  connection strategies, replanning and contraction hierarchies, and are
+ *  skipped with '-c' (collision only).
+ *
+ *  @author agent
+ *  @date 17-10-2026
+*/
+#include "../src/localmap.h"
+#include "../src/cellchecker.h"
+#include "../src/prmplanner.h"
+#include "../src/contractionhierarchy.h"
+
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static unsigned int Iterations = 200000; //Default amount of times each case is repeated
+
+static const double MAP_SIZE = 20.0;  /*!< Size of the benchmark maps (m) */
+static const double MAP_RES = 0.1;    /*!< Resolution of the benchmark maps */
+
+typedef std::pair<cv::Point, cv::Point> TSegment;
+
+/*! @brief Creates a map with random square obstacles.
+ *
+ *  @param pixels The width and height of the map.
+ *  @param obstacles The amount of obstacles to place.
+ *  @return Mat - The map, white is free space.
+ */
+static cv::Mat clutteredMap(int pixels, int obstacles){
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> pos(0, pixels - 5);
+  cv::Mat image(pixels, pixels, CV_8UC1, cv::Scalar(255));
+
+  for(int i = 0; i < obstacles; i++){
+    int x = pos(gen), y = pos(gen);
+
+    for(int dy = 0; dy < 4; dy++){
+      for(int dx = 0; dx < 4; dx++){
+        image.at<uchar>(y + dy, x + dx) = 0;
+      }
+    }
+  }
+
+  return image;
+}
+
+/*! @brief Creates a map split by two walls, each with one narrow gap.
+ *
+ *  @param pixels The width and height of the map.
+ *  @param gap The width of each gap in pixels.
+ *  @return Mat - The map, white is free space.
+ */
+static cv::Mat narrowGapMap(int pixels, int gap){
+  cv::Mat image(pixels, pixels, CV_8UC1, cv::Scalar(255));
+
+  cv::rectangle(image, cv::Point(pixels / 3, 0), cv::Point(pixels / 3 + 10, pixels - 1), cv::Scalar(0), -1);
+  cv::rectangle(image, cv::Point(pixels / 3, pixels / 4), cv::Point(pixels / 3 + 10, pixels / 4 + gap - 1),
+                cv::Scalar(255), -1);
+
+  cv::rectangle(image, cv::Point(2 * pixels / 3, 0), cv::Point(2 * pixels / 3 + 10, pixels - 1), cv::Scalar(0), -1);
+  cv::rectangle(image, cv::Point(2 * pixels / 3, 3 * pixels / 4), cv::Point(2 * pixels / 3 + 10, 3 * pixels / 4 + gap - 1),
+                cv::Scalar(255), -1);
+
+  return image;
+}
+
+/*! @brief Creates random line segments within a map.
+ *
+ *  @param pixels The width and height of the map.
+ *  @param count The amount of segments.
+ *  @return vector - The segments.
+ */
+static std::vector<TSegment> randomSegments(int pixels, int count){
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<int> pos(0, pixels - 1);
+  std::vector<TSegment> segments;
+
+  for(int i = 0; i < count; i++){
+    segments.push_back(TSegment(cv::Point(pos(gen), pos(gen)), cv::Point(pos(gen), pos(gen))));
+  }
+
+  return segments;
+}
+
+/*! @brief Times a collision check over a set of segments.
+ *
+ *  @param name The name of the case to print.
+ *  @param segments The segments to check, repeated until Iterations checks are made.
+ *  @param check The collision check.
+ */
+static void run(const std::string &name, const std::vector<TSegment> &segments,
+                std::function<bool(cv::Point, cv::Point)> check){
+  unsigned int connected = 0;
+  auto begin = std::chrono::steady_clock::now();
+
+  for(unsigned int i = 0; i < Iterations; i++){
+    const TSegment &s = segments[i % segments.size()];
+    connected += check(s.first, s.second);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - begin).count() / Iterations;
+
+  std::cout << "  " << name << ": " << ns << " ns/check (" << connected << " connected)" << std::endl;
+}
+
+/*! @brief The collision check LocalMap::canConnect used to make.
+ *
+ *  Each pixel on a cv::LineIterator was checked with a bounds checked
+ *  isAccessible(), which looks up its row every time.
+ */
+static bool lineIteratorConnect(cv::Mat &cspace, cv::Point start, cv::Point end){
+  cv::LineIterator line(cspace, start, end);
+  for(int i = 0; i < line.count; i++, line++){
+    cv::Point p = line.pos();
+
+    if(p.x < 0 || p.y < 0 || p.x >= cspace.cols || p.y >= cspace.rows || cspace.at<uchar>(p) != 255){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void benchCollision(const std::string &name, cv::Mat cspace){
+  std::vector<TSegment> segments = randomSegments(cspace.cols, 1000);
+
+  std::cout << name << std::endl;
+  run("cv::LineIterator", segments,
+      [&cspace](cv::Point a, cv::Point b){ return lineIteratorConnect(cspace, a, b); });
+  run("COLLISION_LINE", segments,
+      [&cspace](cv::Point a, cv::Point b){ return CellChecker<TGreyCells>::canConnect(cspace, a, b); });
+  run("COLLISION_OFFSETS", segments,
+      [&cspace](cv::Point a, cv::Point b){ return CellChecker<TGreyCells>::canConnectOffsets(cspace, a, b); });
+}
+
+/*! @brief The length of a path.
+ *
+ *  @param path The waypoints of the path.
+ *  @return double - The length of the path (m).
+ */
+static double pathLength(const std::vector<TGlobalOrd> &path){
+  double length = 0;
+
+  for(unsigned int i = 1; i < path.size(); i++){
+    length += std::hypot(path[i].x - path[i - 1].x, path[i].y - path[i - 1].y);
+  }
+
+  return length;
+}
+
+/*! @brief Times building a roadmap, and measures the quality of its paths.
+ *
+ *  The roadmap is built as build() would, PLANNER_BUILD_NODES at a time.
+ *  Paths are then queried between random pairs of its nodes, and their
+ *  stretch (length over straight line distance) is averaged.
+ *
+ *  @param name The name of the case to print.
+ *  @param cspace The expanded configuration space.
+ *  @param strategy The connection strategy to build with.
+ *  @param nodes The size of the roadmap.
+ */
+static void runRoadmap(const std::string &name, cv::Mat cspace, TConnectionStrategy strategy, unsigned int nodes){
+  PrmPlanner planner(MAP_SIZE, MAP_RES, PLANNER_DEF_DENSITY);
+  planner.setReference(TGlobalOrd{MAP_SIZE / 2, MAP_SIZE / 2});
+  planner.setConnectionStrategy(strategy);
+
+  auto begin = std::chrono::steady_clock::now();
+  while(planner.nodeCount() < nodes){
+    if(planner.densify(cspace, std::min(PLANNER_BUILD_NODES, nodes - planner.nodeCount())) == 0){
+      break;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+  TRoadmap roadmap = planner.roadmapChanges();
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<size_t> pick(0, roadmap.nodes.size() - 1);
+
+  unsigned int solved = 0, queries = 200;
+  double stretch = 0;
+  for(unsigned int i = 0; i < queries; i++){
+    TGlobalOrd start = roadmap.nodes[pick(gen)].second, goal = roadmap.nodes[pick(gen)].second;
+    double straight = std::hypot(goal.x - start.x, goal.y - start.y);
+    std::vector<TGlobalOrd> path = planner.query(cspace, start, goal);
+
+    if(path.size() > 0 && straight > 0){
+      stretch += pathLength(path) / straight;
+      solved++;
+    }
+  }
+
+  std::cout << "  " << name << ": " << planner.nodeCount() << " nodes, " << roadmap.edges.size() << " edges, "
+            << planner.edgeChecks() << " edge checks, " << ms << " ms, "
+            << solved << "/" << queries << " solved, stretch " << (solved > 0 ? stretch / solved : 0) << std::endl;
+}
+
+/*! @brief Counts the rounds of build() needed to find a path through narrow gaps.
+ *
+ *  @param name The name of the case to print.
+ *  @param map The map, which is expanded for a 0.2m robot.
+ *  @param strategy The sampling strategy to build with.
+ */
+static void runSampling(const std::string &name, const cv::Mat &map, TSamplingStrategy strategy){
+  const unsigned int trials = 20, maxRounds = 20;
+  unsigned int rounds = 0, nodes = 0, failures = 0;
+
+  for(unsigned int i = 0; i < trials; i++){
+    cv::Mat cspace = map.clone();
+    PrmPlanner planner(MAP_SIZE, MAP_RES, PLANNER_DEF_DENSITY);
+    planner.setReference(TGlobalOrd{MAP_SIZE / 2, MAP_SIZE / 2});
+    planner.expandConfigSpace(cspace, 0.2);
+    planner.setSamplingStrategy(strategy);
+
+    std::vector<TGlobalOrd> path;
+    unsigned int round = 0;
+    while(path.size() == 0 && round < maxRounds){
+      path = planner.build(cspace, TGlobalOrd{1, 1}, TGlobalOrd{MAP_SIZE - 1, MAP_SIZE - 1});
+      round++;
+    }
+
+    if(path.size() == 0){
+      failures++;
+    }
+
+    rounds += round;
+    nodes += planner.nodeCount();
+  }
+
+  std::cout << "  " << name << ": " << (double)rounds / trials << " rounds, " << (double)nodes / trials
+            << " nodes, " << failures << "/" << trials << " not found in " << maxRounds << " rounds" << std::endl;
+}
+
+/*! @brief Times building the skeleton roadmap, which needs only one round.
+ *
+ *  @param name The name of the case to print.
+ *  @param map The map, which is expanded for a 0.2m robot.
+ */
+static void runSkeleton(const std::string &name, const cv::Mat &map){
+  cv::Mat cspace = map.clone();
+  PrmPlanner planner(MAP_SIZE, MAP_RES, PLANNER_DEF_DENSITY);
+  planner.setReference(TGlobalOrd{MAP_SIZE / 2, MAP_SIZE / 2});
+  planner.expandConfigSpace(cspace, 0.2);
+
+  auto begin = std::chrono::steady_clock::now();
+  planner.buildSkeleton(cspace);
+  std::vector<TGlobalOrd> path = planner.build(cspace, TGlobalOrd{1, 1}, TGlobalOrd{MAP_SIZE - 1, MAP_SIZE - 1});
+  auto end = std::chrono::steady_clock::now();
+
+  std::cout << "  " << name << ": 1 round, " << planner.nodeCount() << " nodes, "
+            << std::chrono::duration<double, std::milli>(end - begin).count() << " ms, path "
+            << (path.size() > 0 ? "found" : "not found") << std::endl;
+}
+
+static void benchSampling(const std::string &name, cv::Mat map){
+  std::cout << name << std::endl;
+  runSampling("SAMPLE_UNIFORM ", map, SAMPLE_UNIFORM);
+  runSampling("SAMPLE_GAUSSIAN", map, SAMPLE_GAUSSIAN);
+  runSampling("SAMPLE_BRIDGE  ", map, SAMPLE_BRIDGE);
+  runSkeleton("buildSkeleton  ", map);
+}
+
+/*! @brief Compares replan() against query() as obstacles appear in the roadmap.
+ *
+ *  Each round a small obstacle is added to the map and the edges around it
+ *  updated, then the same path is found by repairing the previous search
+ *  (replan) and by a search from scratch (query). Lastly, transient
+ *  obstacles are added without changing the map, and the path queried.
+ *
+ *  @param name The name of the case to print.
+ *  @param map The map, obstacles are added to a copy.
+ *  @param nodes The size of the roadmap.
+ */
+static void benchReplan(const std::string &name, const cv::Mat &map, unsigned int nodes){
+  cv::Mat cspace = map.clone();
+  PrmPlanner planner(MAP_SIZE, MAP_RES, PLANNER_DEF_DENSITY);
+  planner.setReference(TGlobalOrd{MAP_SIZE / 2, MAP_SIZE / 2});
+
+  while(planner.nodeCount() < nodes){
+    if(planner.densify(cspace, PLANNER_BUILD_NODES) == 0){
+      break;
+    }
+  }
+
+  TGlobalOrd start{0.5, 0.5}, goal{MAP_SIZE - 0.5, MAP_SIZE - 0.5};
+  planner.replan(cspace, start, goal);
+  unsigned long fromScratch = planner.searchExpansions();
+
+  std::mt19937 gen(5);
+  std::uniform_int_distribution<int> pos(10, cspace.cols - 20);
+  unsigned int rounds = 50, removed = 0, differ = 0;
+  double replanMs = 0, queryMs = 0;
+
+  for(unsigned int i = 0; i < rounds; i++){
+    cv::Rect obstacle(pos(gen), pos(gen), 8, 8);
+    cv::rectangle(cspace, obstacle.tl(), obstacle.br(), cv::Scalar(0), -1);
+
+    auto begin = std::chrono::steady_clock::now();
+    removed += planner.updateEdges(cspace, cv::Rect(obstacle.x - 40, obstacle.y - 40, 88, 88));
+    std::vector<TGlobalOrd> repaired = planner.replan(cspace, start, goal);
+    auto middle = std::chrono::steady_clock::now();
+    std::vector<TGlobalOrd> searched = planner.query(cspace, start, goal);
+    auto end = std::chrono::steady_clock::now();
+
+    replanMs += std::chrono::duration<double, std::milli>(middle - begin).count();
+    queryMs += std::chrono::duration<double, std::milli>(end - middle).count();
+    differ += std::abs(pathLength(repaired) - pathLength(searched)) > 1e-6;
+  }
+
+  //A transient obstacle only blocks edges for the search, the network is untouched
+  std::uniform_real_distribution<double> centre(2.0, MAP_SIZE - 2.0);
+  double dynamicMs = 0;
+  for(unsigned int i = 0; i < rounds; i++){
+    auto begin = std::chrono::steady_clock::now();
+    planner.clearDynamicObstacles();
+    planner.addDynamicObstacle(TGlobalOrd{centre(gen), centre(gen)}, 0.6, 1.0);
+    planner.query(cspace, start, goal);
+    auto end = std::chrono::steady_clock::now();
+
+    dynamicMs += std::chrono::duration<double, std::milli>(end - begin).count();
+  }
+
+  std::cout << name << std::endl
+            << "  " << planner.nodeCount() << " nodes, " << removed << " edges removed over " << rounds << " obstacles" << std::endl
+            << "  replan (update + repair): " << replanMs / rounds << " ms, "
+            << (planner.searchExpansions() - fromScratch) / (double)rounds << " expansions ("
+            << fromScratch << " from scratch)" << std::endl
+            << "  query (from scratch):     " << queryMs / rounds << " ms, " << differ << " paths differ" << std::endl
+            << "  dynamic obstacle + query: " << dynamicMs / rounds << " ms" << std::endl;
+}
+
+/*! @brief Compares contraction hierarchy queries with Dijkstra, on a grid graph and a roadmap.
+ *
+ *  @param name The name of the case to print.
+ *  @param map The map the roadmap is built on.
+ *  @param side The width and height of the grid graph.
+ *  @param nodes The size of the roadmap.
+ */
+static void benchHierarchy(const std::string &name, const cv::Mat &map, vertex side, unsigned int nodes){
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> weights(1.0, 2.0);
+  unsigned int queries = 200;
+
+  //A grid is a worst case for the hierarchy, as so many paths are nearly as short
+  Graph grid(8);
+  for(vertex v = 0; v < side * side; v++){
+    grid.addVertex(v);
+  }
+  for(vertex v = 0; v < side * side; v++){
+    if(v % side < side - 1){
+      grid.addEdge(v, v + 1, weights(gen));
+    }
+    if(v / side < side - 1){
+      grid.addEdge(v, v + side, weights(gen));
+    }
+  }
+
+  ContractionHierarchy hierarchy;
+  auto begin = std::chrono::steady_clock::now();
+  hierarchy.build(grid);
+  double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+  TSearchWorkspace forward, backward, workspace;
+  std::uniform_int_distribution<vertex> pick(0, side * side - 1);
+  double hierarchyUs = 0, dijkstraUs = 0, hierarchySettled = 0, dijkstraSettled = 0;
+  unsigned int differ = 0;
+
+  for(unsigned int i = 0; i < queries; i++){
+    vertex start = pick(gen), goal = pick(gen);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<vertex> fast = hierarchy.shortestPath(start, goal, forward, backward);
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<vertex> slow = grid.shortestPath(start, goal, workspace);
+    auto t2 = std::chrono::steady_clock::now();
+
+    hierarchyUs += std::chrono::duration<double, std::micro>(t1 - t0).count();
+    dijkstraUs += std::chrono::duration<double, std::micro>(t2 - t1).count();
+    hierarchySettled += forward.settled + backward.settled;
+    dijkstraSettled += workspace.settled;
+
+    weight fastLength = 0, slowLength = 0;
+    for(unsigned int j = 1; j < fast.size(); j++){
+      fastLength += grid.getWeight(fast[j - 1], fast[j]);
+    }
+    for(unsigned int j = 1; j < slow.size(); j++){
+      slowLength += grid.getWeight(slow[j - 1], slow[j]);
+    }
+    differ += std::abs(fastLength - slowLength) > 1e-9;
+  }
+
+  std::cout << name << std::endl
+            << "  grid " << side * side << " verticies: build " << buildMs << " ms, "
+            << hierarchy.shortcuts() << " shortcuts, " << differ << " paths differ" << std::endl
+            << "    hierarchy: " << hierarchyUs / queries << " us, " << hierarchySettled / queries << " settled" << std::endl
+            << "    dijkstra:  " << dijkstraUs / queries << " us, " << dijkstraSettled / queries << " settled" << std::endl;
+
+  //Queries between the nodes of a roadmap, through PrmPlanner::query
+  cv::Mat cspace = map.clone();
+  PrmPlanner planner(MAP_SIZE, MAP_RES, PLANNER_DEF_DENSITY);
+  planner.setReference(TGlobalOrd{MAP_SIZE / 2, MAP_SIZE / 2});
+
+  while(planner.nodeCount() < nodes){
+    if(planner.densify(cspace, PLANNER_BUILD_NODES) == 0){
+      break;
+    }
+  }
+
+  begin = std::chrono::steady_clock::now();
+  unsigned long shortcuts = planner.buildHierarchy();
+  buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+  std::vector<std::pair<vertex, TGlobalOrd>> roadmapNodes = planner.roadmapChanges().nodes;
+  std::uniform_int_distribution<size_t> pickNode(0, roadmapNodes.size() - 1);
+  hierarchyUs = 0;
+  dijkstraUs = 0;
+  differ = 0;
+
+  for(unsigned int i = 0; i < queries; i++){
+    TGlobalOrd start = roadmapNodes[pickNode(gen)].second, goal = roadmapNodes[pickNode(gen)].second;
+
+    planner.setQueryMethod(QUERY_HIERARCHY);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<TGlobalOrd> fast = planner.query(cspace, start, goal);
+    auto t1 = std::chrono::steady_clock::now();
+    planner.setQueryMethod(QUERY_DIJKSTRA);
+    std::vector<TGlobalOrd> slow = planner.query(cspace, start, goal);
+    auto t2 = std::chrono::steady_clock::now();
+
+    hierarchyUs += std::chrono::duration<double, std::micro>(t1 - t0).count();
+    dijkstraUs += std::chrono::duration<double, std::micro>(t2 - t1).count();
+    differ += std::abs(pathLength(fast) - pathLength(slow)) > 1e-6;
+  }
+
+  std::cout << "  roadmap " << planner.nodeCount() << " nodes: build " << buildMs << " ms, "
+            << shortcuts << " shortcuts, " << differ << " paths differ" << std::endl
+            << "    query (hierarchy): " << hierarchyUs / queries << " us" << std::endl
+            << "    query (dijkstra):  " << dijkstraUs / queries << " us" << std::endl;
+}
+
+static void benchRoadmap(const std::string &name, cv::Mat cspace){
+  std::cout << name << std::endl;
+
+  for(unsigned int nodes: {200, 600, 1200}){
+    std::string size = std::to_string(nodes);
+    runRoadmap("CONNECT_FIXED_K    " + size, cspace, CONNECT_FIXED_K, nodes);
+    runRoadmap("CONNECT_PRM_STAR   " + size, cspace, CONNECT_PRM_STAR, nodes);
+    runRoadmap("CONNECT_VISIBILITY " + size, cspace, CONNECT_VISIBILITY, nodes);
+  }
+}
+
+int main(int argc, char **argv){
+  bool roadmap = true;
+
+  for(int i = 1; i < argc; i++){
+    if(std::string(argv[i]) == "-n" && i + 1 < argc){
+      Iterations = std::stoi(argv[i + 1]);
+      i++;
+    } else if(std::string(argv[i]) == "-c"){
+      roadmap = false;
+    }
+  }
+
+  int pixels = (int)(MAP_SIZE / MAP_RES);
+
+  //An empty map is the worst case, every line is walked to its end
+  benchCollision("Collision (empty map)", cv::Mat(pixels, pixels, CV_8UC1, cv::Scalar(255)));
+  benchCollision("Collision (cluttered map)", clutteredMap(pixels, 200));
+
+  if(roadmap){
+    benchRoadmap("Roadmap (cluttered map)", clutteredMap(pixels, 200));
+    benchSampling("Sampling (narrow gaps)", narrowGapMap(pixels, 5));
+    benchReplan("Replanning (cluttered map)", clutteredMap(pixels, 200), 5000);
+    benchHierarchy("Contraction hierarchy (cluttered map)", clutteredMap(pixels, 200), 150, 5000);
+  }
+
+  return 0;
+}
@@ -3,6 +3,8 @@
 #include "../src/localmap.h"
 #include "../src/graph.h"
 #include "../src/prmplanner.h"
+#include "../src/contractionhierarchy.h"
+#include "../src/cellchecker.h"
 
 #include <iostream>
 #include <string>
@@ -13,6 +15,15 @@
 #include <map>
 #include <utility>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <fstream>
+#include <set>
+#include <algorithm>
 
 static bool ShowPrm = false;        //Default is false
 static unsigned int MaxTries = 10;  //Default max amount of tries is 10 for prm gen
@@ -210,6 +221,122 @@ TEST(ConfigSpace, ConnectOutsideMap){
   ASSERT_FALSE(l.canConnect(img, cv::Point(100, 200), cv::Point(-100, -100)));
 }
 
+TEST(ConfigSpace, ConnectInPackedMap){
+  cv::Mat img = TPackedBitCells::pack(partionedMap());
+
+  ASSERT_FALSE(CellChecker<TPackedBitCells>::canConnect(img, cv::Point(100, 0), cv::Point(100, 199)));
+  ASSERT_TRUE(CellChecker<TPackedBitCells>::canConnect(img, cv::Point(0, 50), cv::Point(199, 50)));
+  ASSERT_TRUE(CellChecker<TPackedBitCells>::canConnect(img, cv::Point(110, 90), cv::Point(150, 50)));
+  ASSERT_FALSE(CellChecker<TPackedBitCells>::canConnect(img, cv::Point(-1, 50), cv::Point(199, 50)));
+}
+
+TEST(ConfigSpace, ConnectWithOffsets){
+  cv::Mat img = partionedMap();
+
+  ASSERT_FALSE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(100, 0), cv::Point(100, 199)));
+  ASSERT_TRUE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(0, 50), cv::Point(199, 50)));
+  ASSERT_TRUE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(150, 50), cv::Point(110, 90)));
+  ASSERT_FALSE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(199, 99), cv::Point(0, 101)));
+  ASSERT_FALSE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(-1, 50), cv::Point(199, 50)));
+
+  //Both ends of the line are checked
+  img.at<uchar>(10, 20) = 0;
+  ASSERT_FALSE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(20, 10), cv::Point(60, 30)));
+  ASSERT_FALSE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(60, 30), cv::Point(20, 10)));
+  ASSERT_TRUE(CellChecker<TGreyCells>::canConnectOffsets(img, cv::Point(21, 10), cv::Point(60, 30)));
+}
+
+TEST(ConfigSpace, ConnectInCostMap){
+  //Free space with a lethal wall, and a costly (but traversable) band
+  cv::Mat img(200, 200, CV_32FC1, cv::Scalar(0));
+  cv::line(img, cv::Point(0, 100), cv::Point(200, 100), cv::Scalar(CELL_COST_LETHAL), 1);
+  cv::line(img, cv::Point(100, 0), cv::Point(100, 200), cv::Scalar(0.5), 1);
+
+  ASSERT_FALSE(CellChecker<TCostCells>::canConnect(img, cv::Point(50, 0), cv::Point(50, 199)));
+  ASSERT_TRUE(CellChecker<TCostCells>::canConnect(img, cv::Point(0, 50), cv::Point(199, 50)));
+}
+
+TEST(ConfigSpace, ClearanceCost){
+  LocalMap l(20.0, 0.1);
+
+  cv::Mat img = partionedMap();
+  cv::Mat costs = l.clearanceCost(img, 1.0);
+
+  //Obstacles are lethal, and cost falls away from them
+  EXPECT_FLOAT_EQ(1.0, costs.at<float>(100, 50));
+  EXPECT_GT(costs.at<float>(102, 50), costs.at<float>(105, 50));
+  EXPECT_FLOAT_EQ(0.0, costs.at<float>(150, 50));
+
+  //A line hugging the wall costs more than one far from it
+  double nearCost, farCost;
+  ASSERT_TRUE(l.canConnect(img, costs, cv::Point(0, 102), cv::Point(199, 102), nearCost));
+  ASSERT_TRUE(l.canConnect(img, costs, cv::Point(0, 150), cv::Point(199, 150), farCost));
+  EXPECT_GT(nearCost, farCost);
+
+  //Costs don't change what can be connected
+  ASSERT_FALSE(l.canConnect(img, costs, cv::Point(100, 0), cv::Point(100, 199), nearCost));
+
+  //The offsets backend walks the cost map along the same cells it checks
+  l.setCollisionBackend(COLLISION_OFFSETS);
+  double offsetsCost;
+  ASSERT_FALSE(l.canConnect(img, costs, cv::Point(100, 0), cv::Point(100, 199), offsetsCost));
+
+  cv::Mat speckled(200, 200, CV_8UC1, cv::Scalar(255));
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> ord(0, 199);
+  for(unsigned int i = 0; i < 400; ++i){
+    speckled.at<uchar>(ord(rng), ord(rng)) = 0;
+  }
+  cv::Mat speckledCosts = l.clearanceCost(speckled, 1.0);
+
+  for(unsigned int i = 0; i < 500; ++i){
+    cv::Point a(ord(rng), ord(rng)), b(ord(rng), ord(rng));
+    double lineCost;
+    bool connected = CellChecker<TGreyCells>::canConnect(speckled, speckledCosts, a, b, lineCost);
+    ASSERT_EQ(connected, l.canConnect(speckled, speckledCosts, a, b, offsetsCost));
+    ASSERT_EQ(connected, l.canConnect(speckled, a, b));
+    if(connected){
+      EXPECT_DOUBLE_EQ(lineCost, offsetsCost);
+    }
+  }
+
+  //A straight line visits the same cells either way
+  ASSERT_TRUE(l.canConnect(img, costs, cv::Point(0, 102), cv::Point(199, 102), offsetsCost));
+  EXPECT_DOUBLE_EQ(nearCost, offsetsCost);
+}
+
+TEST(ConfigSpace, ChangedRegion){
+  LocalMap l(20.0, 0.1);
+
+  cv::Mat before = partionedMap();
+  cv::Mat after = before.clone();
+  EXPECT_EQ(0, l.changedRegion(before, after).area());
+
+  //Only the pixels that differ are bounded
+  cv::line(after, cv::Point(20, 30), cv::Point(60, 45), cv::Scalar(0), 1);
+  after.at<uchar>(100, 150) = 255;
+  EXPECT_EQ(cv::Rect(20, 30, 131, 71), l.changedRegion(before, after));
+
+  //A map of another size has changed everywhere
+  cv::Mat larger(300, 300, CV_8UC1, cv::Scalar(255));
+  EXPECT_EQ(cv::Rect(0, 0, 300, 300), l.changedRegion(before, larger));
+
+  //A map that has moved is compared where it overlaps, even if the shift is a pixel out
+  cv::Mat site = partionedMap2();
+  cv::Mat moved(site.rows, site.cols, CV_8UC1, cv::Scalar(127));
+  site(cv::Rect(10, 0, 190, 195)).copyTo(moved(cv::Rect(0, 5, 190, 195)));
+  std::vector<cv::Rect> regions = l.changedRegions(site, moved, cv::Point(-9, 5), 1);
+  ASSERT_EQ(2, regions.size());
+  EXPECT_EQ(cv::Rect(0, 0, 200, 5), regions[0]);
+  EXPECT_EQ(cv::Rect(190, 5, 10, 195), regions[1]);
+
+  //With a change inside the overlap bounded first
+  moved.at<uchar>(100, 50) = 0;
+  regions = l.changedRegions(site, moved, cv::Point(-10, 5), 0);
+  ASSERT_EQ(3, regions.size());
+  EXPECT_EQ(cv::Rect(50, 100, 1, 1), regions[0]);
+}
+
 /* Tests for converting from TGlobalOrds to local OgMap points */
 
 TEST(LocalMap, ConvertPositivePoints){
@@ -263,6 +390,138 @@ TEST(LocalMap, ConvertPointsOnLine){
   EXPECT_EQ(cv::Point(100, 150), l.convertToPoint(ref, p4));
 }
 
+TEST(LocalMap, ConvertRectangularMap){
+  LocalMap l(30.0, 4.0, 0.1);
+
+  TGlobalOrd ref = {10, 10};
+  TGlobalOrd p1 = {0, 11}, p2 = {24, 8.5}, p3 = {10, 13};
+
+  EXPECT_EQ(cv::Point(50, 10), l.convertToPoint(ref, p1));
+  EXPECT_EQ(cv::Point(290, 35), l.convertToPoint(ref, p2));
+  EXPECT_TRUE(l.inMap(l.convertToPoint(ref, p2)));
+  EXPECT_FALSE(l.inMap(l.convertToPoint(ref, p3))); //Beyond the height of the map
+
+  //The reference at the bottom left of the map
+  l.setOrigin(cv::Point(0, 39));
+  EXPECT_EQ(cv::Point(0, 39), l.convertToPoint(ref, ref));
+  EXPECT_EQ(cv::Point(140, 29), l.convertToPoint(ref, TGlobalOrd{24, 11}));
+  EXPECT_FALSE(l.inMap(l.convertToPoint(ref, p1)));
+}
+
+TEST(LocalMap, ConvertBatch){
+  LocalMap l(20.0, 0.1);
+
+  TGlobalOrd ref = {10, 10};
+  std::vector<TGlobalOrd> ords = {{5, 15}, {15, 5}, {5.1, 15.2}, {5.15, 15.23}, {10, -10}, {10, 10}};
+  std::vector<cv::Point> points;
+
+  l.convertToPoints(ref, ords, points);
+
+  //Must agree with converting each ordinate on its own
+  ASSERT_EQ(ords.size(), points.size());
+  for(unsigned int i = 0; i < ords.size(); i++){
+    EXPECT_EQ(l.convertToPoint(ref, ords[i]), points[i]);
+  }
+}
+
+TEST(LocalMap, FromOccupancyGrid){
+  //Grid rows start at the bottom of the map
+  std::vector<int8_t> grid = {  0,  10, 100,
+                               -1,  50,  65,
+                                0,   0,   0};
+
+  cv::Mat cspace = LocalMap::fromOccupancyGrid(grid.data(), 3, 3, 10, 65);
+
+  ASSERT_EQ(3, cspace.rows);
+  ASSERT_EQ(3, cspace.cols);
+  ASSERT_EQ(CV_8UC1, cspace.type());
+
+  //Top row of the image is the last row of the grid
+  EXPECT_EQ(255, cspace.at<uchar>(0, 0));
+  EXPECT_EQ(255, cspace.at<uchar>(0, 2));
+
+  EXPECT_EQ(127, cspace.at<uchar>(1, 0)); //Unknown
+  EXPECT_EQ(127, cspace.at<uchar>(1, 1)); //Between thresholds
+  EXPECT_EQ(0, cspace.at<uchar>(1, 2));   //At the occupied threshold
+
+  EXPECT_EQ(255, cspace.at<uchar>(2, 0));
+  EXPECT_EQ(255, cspace.at<uchar>(2, 1)); //At the free threshold
+  EXPECT_EQ(0, cspace.at<uchar>(2, 2));
+}
+
+TEST(LocalMap, ConvertToOrd){
+  LocalMap l(20.0, 0.1);
+  TGlobalOrd ref = {10, 10};
+  std::vector<TGlobalOrd> ords = {{5, 15}, {15, 5}, {5.1, 15.2}, {10, 10}, {0.3, 0.1}};
+
+  for(auto const &ord: ords){
+    TGlobalOrd converted = l.convertToOrd(ref, l.convertToPoint(ref, ord));
+
+    EXPECT_NEAR(ord.x, converted.x, 1e-9);
+    EXPECT_NEAR(ord.y, converted.y, 1e-9);
+  }
+}
+
+TEST(LocalMap, KnownExtent){
+  LocalMap l(20.0, 0.1);
+
+  //An unexplored map, other than a small free room with a wall
+  cv::Mat img(200, 200, CV_8UC1, cv::Scalar(127));
+  cv::rectangle(img, cv::Point(50, 60), cv::Point(69, 69), cv::Scalar(255), -1);
+  cv::line(img, cv::Point(50, 70), cv::Point(69, 70), cv::Scalar(0), 1);
+
+  EXPECT_EQ(cv::Rect(50, 60, 20, 11), l.knownExtent(img, 0));
+  EXPECT_EQ(cv::Rect(45, 55, 30, 21), l.knownExtent(img, 5));
+  EXPECT_EQ(cv::Rect(0, 0, 170, 171), l.knownExtent(img, 100));
+
+  //All free space is within the extent
+  EXPECT_DOUBLE_EQ(l.freeConfigSpace(img), l.freeConfigSpace(img, l.knownExtent(img, 0)));
+
+  cv::Mat unknown(200, 200, CV_8UC1, cv::Scalar(127));
+  EXPECT_TRUE(l.knownExtent(unknown, 5).empty());
+}
+
+TEST(LocalMap, ExpandKnownConfigSpace){
+  //Expanding away from the planner (as the cspace stage does) must give
+  //the same cspace and extent as the planner expanding it itself
+  cv::Mat img(200, 200, CV_8UC1, cv::Scalar(127));
+  cv::rectangle(img, cv::Point(50, 60), cv::Point(89, 99), cv::Scalar(255), -1);
+  cv::line(img, cv::Point(50, 80), cv::Point(69, 80), cv::Scalar(0), 1);
+  cv::Mat expanded = img.clone();
+
+  LocalMap l(20.0, 0.1);
+  cv::Rect extent = l.expandKnownConfigSpace(expanded, cv::Point(100, 100), 0.4, PLANNER_EXTENT_MARGIN);
+  EXPECT_EQ(cv::Rect(40, 50, 60, 60), extent);
+
+  PrmPlanner g;
+  g.setReference(TGlobalOrd{10, 10});
+  g.expandConfigSpace(img, 0.4);
+
+  cv::Mat diff;
+  cv::absdiff(img, expanded, diff);
+  EXPECT_EQ(0, cv::countNonZero(diff));
+}
+
+TEST(LocalMap, Skeleton){
+  LocalMap l(20.0, 0.1);
+
+  //A corridor, whose skeleton is the line along its middle
+  cv::Mat img(200, 200, CV_8UC1, cv::Scalar(0));
+  cv::rectangle(img, cv::Point(20, 90), cv::Point(180, 110), cv::Scalar(255), -1);
+
+  cv::Mat skel = l.skeleton(img, cv::Rect(0, 0, 200, 200));
+  ASSERT_GT(cv::countNonZero(skel), 100);
+
+  for(int y = 0; y < skel.rows; y++){
+    for(int x = 0; x < skel.cols; x++){
+      if(skel.at<uchar>(y, x) == 255){
+        EXPECT_TRUE(y >= 99 && y <= 101);
+        EXPECT_EQ(255, img.at<uchar>(y, x));
+      }
+    }
+  }
+}
+
 /* Tests for rendering on an OgMap (opencv image) */
 
 TEST(LocalMap, RenderPRM){
@@ -438,6 +697,417 @@ TEST(PrmGen, Hallway){
   ASSERT_TRUE(path.size() > 0);
 }
 
+TEST(PrmGen, RectangularAisle){
+  //A long thin aisle, with a shelf to go around
+  cv::Mat map(40, 300, CV_8UC1, cv::Scalar(255));
+  cv::rectangle(map, cv::Point(140, 0), cv::Point(160, 25), cv::Scalar(0), -1);
+
+  TGlobalOrd robot{15, 2}, start{1, 1}, goal{29, 1};
+  PrmPlanner g(30.0, 4.0, 0.1, PLANNER_DEF_DENSITY);
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+
+  std::vector<TGlobalOrd> path;
+
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+
+  ASSERT_TRUE(path.size() > 0);
+
+  //The path must stay within the aisle
+  for(auto const &ord: path){
+    EXPECT_TRUE(ord.x >= 0 && ord.x <= 30 && ord.y >= 0 && ord.y <= 4);
+  }
+}
+
+TEST(PrmGen, Densify){
+  cv::Mat map = partionedMap2();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+
+  //Build the network before there is a goal
+  unsigned int added = 0;
+  for(int i = 0; i < MaxTries; i++){
+    added += g.densify(map, 200);
+  }
+
+  //Only a batch's own nodes are joined, older ones aren't checked again
+  unsigned long checks = g.edgeChecks();
+  unsigned int batch = g.densify(map, 50);
+  added += batch;
+  EXPECT_LE(g.edgeChecks() - checks, batch * PLANNER_DEF_DENSITY);
+
+  ASSERT_EQ(added, g.nodeCount());
+  ASSERT_TRUE(added > 0);
+
+  //The start and goal are then joined to the existing network, without sampling more nodes
+  std::vector<TGlobalOrd> path = g.build(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+  EXPECT_LE(g.nodeCount(), added + 2);
+}
+
+TEST(PrmGen, Replan){
+  cv::Mat map(200, 200, CV_8UC1, cv::Scalar(255));
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{19, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+  g.densify(map, 400);
+
+  std::vector<TGlobalOrd> path = g.replan(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+
+  //An obstacle appears in the middle of the map, across the straight line path.
+  //Only the changed pixels are given, edges passing over them are still checked
+  cv::Mat before = map.clone();
+  cv::rectangle(map, cv::Point(60, 60), cv::Point(140, 140), cv::Scalar(0), -1);
+  cv::Rect changed = LocalMap::changedRegion(before, map);
+  EXPECT_EQ(cv::Rect(60, 60, 81, 81), changed);
+  EXPECT_GT(g.updateEdges(map, changed), 0);
+  EXPECT_EQ(0, g.updateEdges(map, cv::Rect(0, 0, 200, 200)));
+
+  path = g.replan(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+
+  //Every leg of the repaired path must avoid the obstacle (6m to 14m, less a pixel
+  //either side as edges are checked along pixelated lines)
+  for(unsigned int i = 1; i < path.size(); i++){
+    for(double t = 0; t <= 1.0; t += 0.01){
+      double x = path[i - 1].x + t * (path[i].x - path[i - 1].x);
+      double y = path[i - 1].y + t * (path[i].y - path[i - 1].y);
+      ASSERT_FALSE(x > 6.1 && x < 13.9 && y > 6.1 && y < 13.9);
+    }
+  }
+}
+
+TEST(PrmGen, DynamicObstacle){
+  cv::Mat map(200, 200, CV_8UC1, cv::Scalar(255));
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{19, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+  g.densify(map, 400);
+
+  std::vector<TGlobalOrd> path;
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+  ASSERT_TRUE(path.size() > 0);
+  unsigned int nodes = g.nodeCount();
+
+  auto clearOf = [](const std::vector<TGlobalOrd> &path, TGlobalOrd centre, double radius){
+    for(unsigned int i = 1; i < path.size(); i++){
+      for(double t = 0; t <= 1.0; t += 0.01){
+        double x = path[i - 1].x + t * (path[i].x - path[i - 1].x);
+        double y = path[i - 1].y + t * (path[i].y - path[i - 1].y);
+        if(std::hypot(x - centre.x, y - centre.y) < radius){
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+
+  //A person stands on the straight line path, which is only blocked while they are there
+  TGlobalOrd person{10, 10};
+  g.addDynamicObstacle(person, 3.0, 0.1);
+
+  path = g.query(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+  EXPECT_TRUE(clearOf(path, person, 3.0));
+  EXPECT_GT(g.blockedEdgeCount(), 0);
+
+  path = g.replan(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+  EXPECT_TRUE(clearOf(path, person, 3.0));
+
+  //The network isn't changed by the obstacle
+  EXPECT_EQ(nodes, g.nodeCount());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  path = g.replan(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+  EXPECT_EQ(0, g.blockedEdgeCount());
+  EXPECT_FALSE(clearOf(path, person, 3.0));
+
+  //Edges added while an obstacle stands are blocked as they're made, as a full scan would
+  g.addDynamicObstacle(person, 3.0, 60.0);
+  ASSERT_TRUE(g.query(map, start, goal).size() > 0);
+  unsigned int blocked = g.blockedEdgeCount();
+
+  g.densify(map, 200);
+  path = g.query(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+  EXPECT_TRUE(clearOf(path, person, 3.0));
+  unsigned int grown = g.blockedEdgeCount();
+  EXPECT_GT(grown, blocked);
+
+  g.clearDynamicObstacles();
+  g.addDynamicObstacle(person, 3.0, 60.0);
+  ASSERT_TRUE(g.query(map, start, goal).size() > 0);
+  EXPECT_EQ(grown, g.blockedEdgeCount());
+}
+
+TEST(PrmGen, DistanceToSegment){
+  TGlobalOrd o1 = {0, 0}, o2 = {4, 0};
+
+  //Beside the segment, beyond either end, and to a segment of no length
+  EXPECT_DOUBLE_EQ(3.0, PrmPlanner::distanceToSegment(TGlobalOrd{2, 3}, o1, o2));
+  EXPECT_DOUBLE_EQ(5.0, PrmPlanner::distanceToSegment(TGlobalOrd{-3, -4}, o1, o2));
+  EXPECT_DOUBLE_EQ(1.0, PrmPlanner::distanceToSegment(TGlobalOrd{5, 0}, o1, o2));
+  EXPECT_DOUBLE_EQ(5.0, PrmPlanner::distanceToSegment(TGlobalOrd{3, 4}, o1, o1));
+}
+
+TEST(PrmGen, CheckPath){
+  cv::Mat map(200, 200, CV_8UC1, cv::Scalar(255));
+
+  //A wall the path has to go around
+  cv::rectangle(map, cv::Point(95, 60), cv::Point(105, 199), cv::Scalar(0), -1);
+
+  TGlobalOrd robot{10, 10}, start{2, 2}, goal{18, 2};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+  g.densify(map, 600);
+
+  std::vector<TGlobalOrd> path;
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+  ASSERT_TRUE(path.size() > 2);
+
+  std::vector<TGlobalOrd> original = path;
+  EXPECT_EQ(PATH_VALID, g.checkPath(map, path));
+  EXPECT_EQ(original.size(), path.size());
+
+  //Block the middle of the longest segment
+  unsigned int longest = 0;
+  for(unsigned int i = 1; i + 1 < path.size(); i++){
+    if(std::hypot(path[i + 1].x - path[i].x, path[i + 1].y - path[i].y) >
+       std::hypot(path[longest + 1].x - path[longest].x, path[longest + 1].y - path[longest].y)){
+      longest = i;
+    }
+  }
+
+  LocalMap lmap(20.0, 0.1);
+  TGlobalOrd middle{(path[longest].x + path[longest + 1].x) / 2, (path[longest].y + path[longest + 1].y) / 2};
+  cv::circle(map, lmap.convertToPoint(robot, middle), 4, cv::Scalar(0), -1);
+
+  ASSERT_EQ(PATH_REPAIRED, g.checkPath(map, path));
+  EXPECT_EQ(original.front().x, path.front().x);
+  EXPECT_EQ(original.back().x, path.back().x);
+
+  //Every segment of the repaired path is free
+  for(unsigned int i = 1; i < path.size(); i++){
+    EXPECT_TRUE(lmap.canConnect(map, lmap.convertToPoint(robot, path[i - 1]), lmap.convertToPoint(robot, path[i])));
+  }
+  EXPECT_EQ(PATH_VALID, g.checkPath(map, path));
+
+  //A person standing on a waypoint is detoured around, rejoining the path after them.
+  //The network is grown first, so it has a way around them wherever they stand
+  g.densify(map, 1200);
+  //They stand on the waypoint furthest from its neighbours, and don't reach them
+  unsigned int stood = 0;
+  double spacing = 0;
+  for(unsigned int i = 1; i + 1 < path.size(); i++){
+    double d = std::min(std::hypot(path[i].x - path[i - 1].x, path[i].y - path[i - 1].y),
+                        std::hypot(path[i + 1].x - path[i].x, path[i + 1].y - path[i].y));
+    if(d > spacing){
+      spacing = d;
+      stood = i;
+    }
+  }
+  ASSERT_GT(stood, 0);
+  const double radius = std::min(0.3, spacing / 3);
+
+  TGlobalOrd person = path[stood];
+  g.addDynamicObstacle(person, radius, 60.0);
+  ASSERT_EQ(PATH_REPAIRED, g.checkPath(map, path));
+  EXPECT_EQ(original.back().x, path.back().x);
+  for(unsigned int i = 1; i < path.size(); i++){
+    EXPECT_GT(PrmPlanner::distanceToSegment(person, path[i - 1], path[i]), radius);
+  }
+  g.clearDynamicObstacles();
+
+  //A path from the robot's position (not a node) is repaired without adding it to the network
+  path.front() = TGlobalOrd{path.front().x + 0.05, path.front().y + 0.05};
+  TGlobalOrd across{(path[0].x + path[1].x) / 2, (path[0].y + path[1].y) / 2};
+  double length = std::hypot(path[1].x - path[0].x, path[1].y - path[0].y);
+  g.addDynamicObstacle(across, std::min(0.5, length / 3), 60.0);
+
+  unsigned int nodes = g.nodeCount();
+  ASSERT_EQ(PATH_REPAIRED, g.checkPath(map, path));
+  EXPECT_EQ(nodes, g.nodeCount());
+  EXPECT_DOUBLE_EQ(original.front().x + 0.05, path.front().x);
+  g.clearDynamicObstacles();
+
+  //A robot whose nearest node is the waypoint it rejoins goes straight to it
+  TGlobalOrd near{goal.x - 0.05, goal.y + 0.05}, aside{goal.x - 1.0, goal.y + 1.0};
+  std::vector<TGlobalOrd> last{near, aside, goal};
+  g.addDynamicObstacle(aside, 0.3, 60.0);
+
+  ASSERT_EQ(PATH_REPAIRED, g.checkPath(map, last));
+  ASSERT_EQ(2, last.size());
+  EXPECT_DOUBLE_EQ(near.x, last.front().x);
+  EXPECT_DOUBLE_EQ(goal.x, last.back().x);
+  g.clearDynamicObstacles();
+
+  //A goal that is walled in can't be repaired
+  cv::circle(map, lmap.convertToPoint(robot, goal), 10, cv::Scalar(0), 3);
+  EXPECT_EQ(PATH_BLOCKED, g.checkPath(map, path));
+}
+
+TEST(PrmGen, PrmStar){
+  cv::Mat map = partionedMap2();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+  g.setConnectionStrategy(CONNECT_PRM_STAR);
+
+  std::vector<TGlobalOrd> path;
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+  ASSERT_TRUE(path.size() > 0);
+
+  //Degree is no longer capped by density
+  std::map<vertex, unsigned int> degree;
+  unsigned int maxDegree = 0;
+  for(auto const &e: g.roadmapChanges().edges){
+    maxDegree = std::max(maxDegree, ++degree[e.first]);
+    maxDegree = std::max(maxDegree, ++degree[e.second]);
+  }
+  EXPECT_GT(maxDegree, PLANNER_DEF_DENSITY);
+
+  //Only new nodes are joined, each to at most k neighbours
+  unsigned long checks = g.edgeChecks();
+  unsigned int added = g.densify(map, 50);
+  unsigned int k = std::ceil(PLANNER_PRM_STAR_K * std::log((double)g.nodeCount()));
+
+  ASSERT_TRUE(added > 0);
+  EXPECT_LE(g.edgeChecks() - checks, added * k);
+}
+
+TEST(PrmGen, Visibility){
+  cv::Mat map = partionedMap2();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+  g.setConnectionStrategy(CONNECT_VISIBILITY);
+
+  std::vector<TGlobalOrd> path;
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+  ASSERT_TRUE(path.size() > 0);
+
+  //Only guards and connectors are kept, far fewer than a build samples
+  EXPECT_LT(g.nodeCount(), PLANNER_BUILD_NODES);
+
+  //Once the space is covered, hardly any more samples are kept
+  unsigned int nodes = g.nodeCount();
+  g.densify(map, PLANNER_BUILD_NODES);
+  EXPECT_LT(g.nodeCount(), nodes + PLANNER_BUILD_NODES / 10);
+
+  //A loaded network keeps its guards, so still covers the space
+  std::string file = "prm_sim_visibility_test.roadmap";
+  ASSERT_TRUE(g.saveRoadmap(file));
+
+  PrmPlanner loaded;
+  loaded.setReference(robot);
+  loaded.setConnectionStrategy(CONNECT_VISIBILITY);
+  ASSERT_TRUE(loaded.loadRoadmap(file));
+  std::remove(file.c_str());
+
+  nodes = loaded.nodeCount();
+  loaded.densify(map, PLANNER_BUILD_NODES);
+  EXPECT_LE(loaded.nodeCount(), nodes + 1);
+}
+
+TEST(PrmGen, VisibilitySplit){
+  //A wall with a gap in the middle, guards either side of it and a connector in the gap
+  cv::Mat map(200, 200, CV_8UC1, cv::Scalar(255));
+  cv::rectangle(map, cv::Point(98, 0), cv::Point(102, 85), cv::Scalar(0), -1);
+  cv::rectangle(map, cv::Point(98, 115), cv::Point(102, 199), cv::Scalar(0), -1);
+
+  TGlobalOrd robot{10, 10}, left{5, 4}, right{15, 4}, gap{10, 10};
+  std::string file = "prm_sim_split_test.roadmap";
+  {
+    std::ofstream out(file);
+    out << "prm_sim_roadmap " << PLANNER_ROADMAP_VERSION << "\n"
+        << "nodes 3\n0 " << left.x << " " << left.y << "\n1 " << right.x << " " << right.y
+        << "\n2 " << gap.x << " " << gap.y << "\n"
+        << "edges 2\n0 2 " << std::hypot(5.0, 6.0) << "\n1 2 " << std::hypot(5.0, 6.0) << "\n"
+        << "guards 2\n0\n1\n"
+        << "hierarchy 0 0 0 0\n";
+  }
+
+  PrmPlanner g;
+  g.setReference(robot);
+  g.setConnectionStrategy(CONNECT_VISIBILITY);
+  ASSERT_TRUE(g.loadRoadmap(file));
+  std::remove(file.c_str());
+
+  //Checks if one vertex can reach another over the roadmap's edges
+  auto reachable = [&g](vertex from, vertex to){
+    TRoadmap roadmap = g.roadmapChanges();
+    std::set<vertex> reached{from};
+    bool grown = true;
+    while(grown){
+      grown = false;
+      for(auto const &e: roadmap.edges){
+        if(reached.count(e.first) != reached.count(e.second)){
+          reached.insert(e.first);
+          reached.insert(e.second);
+          grown = true;
+        }
+      }
+    }
+    return reached.count(to) > 0;
+  };
+  ASSERT_TRUE(reachable(0, 1));
+
+  //Blocking the connector's edge to the right guard splits the roadmap in two
+  LocalMap lmap(20.0, 0.1);
+  TGlobalOrd middle{(gap.x + right.x) / 2, (gap.y + right.y) / 2};
+  cv::circle(map, lmap.convertToPoint(robot, middle), 3, cv::Scalar(0), -1);
+  ASSERT_EQ(1, g.updateEdges(map, cv::Rect(0, 0, 200, 200)));
+  g.resetRoadmap();
+  ASSERT_FALSE(reachable(0, 1));
+
+  //Samples that see both halves are connectors again, rather than redundant
+  g.densify(map, 500);
+  g.resetRoadmap();
+  EXPECT_TRUE(reachable(0, 1));
+}
+
 TEST(PrmGen, Pole){
   cv::Mat map = pole();
   cv::Mat colourMap;
@@ -496,6 +1166,56 @@ TEST(PrmGen, Passage){
   ASSERT_TRUE(path.size() > 0);
 }
 
+TEST(PrmGen, ObstacleBiasedPassage){
+  //Samples concentrated near obstacles and in gaps find the narrow passages
+  for(auto strategy: {SAMPLE_GAUSSIAN, SAMPLE_BRIDGE}){
+    cv::Mat map = passage();
+
+    TGlobalOrd robot{10, 10}, start{1, 1}, goal{19, 19};
+    PrmPlanner g;
+
+    g.setReference(robot);
+    g.expandConfigSpace(map, 0.2);
+    g.setSamplingStrategy(strategy);
+
+    std::vector<TGlobalOrd> path;
+    int cnt(0);
+    while(path.size() <= 0 && cnt < MaxTries){
+      path = g.build(map, start, goal);
+      cnt++;
+    }
+
+    ASSERT_TRUE(path.size() > 0);
+
+    //Every node must still lie in free space
+    for(auto const &node: g.roadmapChanges().nodes){
+      EXPECT_TRUE(g.ordinateAccessible(map, node.second));
+    }
+  }
+}
+
+TEST(PrmGen, Skeleton){
+  cv::Mat map = passage();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{19, 19};
+  PrmPlanner g, h;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+  h.setReference(robot);
+
+  //The same map always gives the same network
+  unsigned int nodes = g.buildSkeleton(map);
+  ASSERT_GT(nodes, 0u);
+  EXPECT_EQ(nodes, h.buildSkeleton(map));
+  EXPECT_EQ(g.roadmapChanges().edges.size(), h.roadmapChanges().edges.size());
+
+  //The start and goal only need joining to it
+  std::vector<TGlobalOrd> path = g.build(map, start, goal);
+  ASSERT_TRUE(path.size() > 0);
+  EXPECT_EQ(nodes + 2, g.nodeCount());
+}
+
 TEST(PrmGen, NoPath){
   //The start is in an unreachable section of the map
   cv::Mat map = partionedMap2();
@@ -512,6 +1232,290 @@ TEST(PrmGen, NoPath){
   EXPECT_EQ(0, path.size());
 }
 
+TEST(PrmGen, IncrementalOverlay){
+  //Drawing the network round by round should give the same image as
+  //drawing the whole network at once
+  cv::Mat map = partionedMap2();
+  cv::Mat base, layer, full;
+  cv::cvtColor(map, base, CV_GRAY2BGR);
+  layer = base.clone();
+  full = base.clone();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+
+  for(int i = 0; i < 3; i++){
+    g.build(map, start, goal);
+    g.updateOverlay(layer, base);
+  }
+
+  g.showOverlay(full, std::vector<TGlobalOrd>());
+
+  cv::Mat diff;
+  cv::absdiff(layer, full, diff);
+  EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+
+  //Removed edges are erased, leaving the edges that crossed them
+  cv::rectangle(map, cv::Point(90, 60), cv::Point(110, 140), cv::Scalar(0), -1);
+  ASSERT_GT(g.updateEdges(map, cv::Rect(90, 60, 21, 81)), 0);
+  g.updateOverlay(layer, base);
+
+  full = base.clone();
+  g.showOverlay(full, std::vector<TGlobalOrd>());
+  cv::absdiff(layer, full, diff);
+  EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+}
+
+TEST(PrmGen, RoadmapChanges){
+  cv::Mat map = partionedMap2();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+  g.build(map, start, goal);
+
+  //The first set of changes is the whole network
+  TRoadmap first = g.roadmapChanges();
+  EXPECT_TRUE(first.reset);
+  EXPECT_GT(first.nodes.size(), 0);
+
+  //With nothing built since, there are no changes
+  TRoadmap none = g.roadmapChanges();
+  EXPECT_FALSE(none.reset);
+  EXPECT_EQ(0, none.nodes.size());
+  EXPECT_EQ(0, none.edges.size());
+
+  //Only the new nodes are sent after building again
+  g.build(map, start, goal);
+  TRoadmap delta = g.roadmapChanges();
+  EXPECT_FALSE(delta.reset);
+
+  for(auto const &node: delta.nodes){
+    for(auto const &old: first.nodes){
+      EXPECT_NE(old.first, node.first);
+    }
+  }
+
+  //After a reset, the whole network is sent again
+  g.resetRoadmap();
+  TRoadmap all = g.roadmapChanges();
+  EXPECT_TRUE(all.reset);
+  EXPECT_EQ(first.nodes.size() + delta.nodes.size(), all.nodes.size());
+  EXPECT_EQ(first.edges.size() + delta.edges.size(), all.edges.size());
+
+  //Blocked edges are sent as removals, without resending the network
+  cv::rectangle(map, cv::Point(90, 60), cv::Point(110, 140), cv::Scalar(0), -1);
+  unsigned int removed = g.updateEdges(map, cv::Rect(90, 60, 21, 81));
+  ASSERT_GT(removed, 0);
+
+  TRoadmap blocked = g.roadmapChanges();
+  EXPECT_FALSE(blocked.reset);
+  EXPECT_EQ(0, blocked.nodes.size());
+  EXPECT_EQ(0, blocked.edges.size());
+  EXPECT_EQ(removed, blocked.removedEdges.size());
+
+  g.resetRoadmap();
+  EXPECT_EQ(all.edges.size() - removed, g.roadmapChanges().edges.size());
+}
+
+TEST(PrmGen, BatchQuery){
+  cv::Mat map = partionedMap2();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+
+  std::vector<TGlobalOrd> path;
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+  ASSERT_TRUE(path.size() > 0);
+
+  //Queries answered concurrently must match those answered one at a time
+  std::vector<std::pair<TGlobalOrd, TGlobalOrd>> pairs;
+  for(int i = 0; i < 50; i++){
+    pairs.push_back(std::make_pair(start, goal));
+    pairs.push_back(std::make_pair(goal, start));
+    pairs.push_back(std::make_pair(start, TGlobalOrd{1, 5})); //Not in the network
+  }
+
+  std::vector<std::vector<TGlobalOrd>> paths = g.query(map, pairs, 4);
+  ASSERT_EQ(pairs.size(), paths.size());
+
+  for(unsigned int i = 0; i < pairs.size(); i++){
+    std::vector<TGlobalOrd> expected = g.query(map, pairs[i].first, pairs[i].second);
+    ASSERT_EQ(expected.size(), paths[i].size());
+
+    for(unsigned int j = 0; j < expected.size(); j++){
+      EXPECT_TRUE(expected[j] == paths[i][j]);
+    }
+  }
+
+  //Paths reused by the next batch are replaced, not appended to
+  std::vector<std::vector<TGlobalOrd>> reused = paths;
+  std::reverse(pairs.begin(), pairs.end());
+  g.query(map, pairs, reused, 4);
+  ASSERT_EQ(pairs.size(), reused.size());
+  for(unsigned int i = 0; i < pairs.size(); i++){
+    EXPECT_EQ(paths[pairs.size() - 1 - i].size(), reused[i].size());
+  }
+}
+
+TEST(PrmGen, Hierarchy){
+  cv::Mat map = partionedMap2();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+
+  std::vector<TGlobalOrd> path;
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+  ASSERT_TRUE(path.size() > 0);
+
+  EXPECT_FALSE(g.hierarchyCurrent());
+
+  //A hierarchy built from a copy is only installed if the network hasn't changed since
+  unsigned long version;
+  ContractionHierarchy copy;
+  copy.build(g.networkGraph(version));
+  EXPECT_FALSE(g.installHierarchy(copy, version + 1));
+  EXPECT_FALSE(g.hierarchyCurrent());
+  EXPECT_TRUE(g.installHierarchy(copy, version));
+  EXPECT_TRUE(g.hierarchyCurrent());
+
+  //The hierarchy finds the same path as searching the whole network
+  g.setQueryMethod(QUERY_HIERARCHY);
+  std::vector<TGlobalOrd> fast = g.query(map, start, goal);
+  ASSERT_EQ(path.size(), fast.size());
+  for(unsigned int i = 0; i < path.size(); i++){
+    EXPECT_TRUE(path[i] == fast[i]);
+  }
+
+  //The network and hierarchy are loaded as they were saved
+  std::string file = "prm_sim_hierarchy_test.roadmap";
+  ASSERT_TRUE(g.saveRoadmap(file));
+
+  PrmPlanner loaded;
+  loaded.setReference(robot);
+  EXPECT_FALSE(loaded.loadRoadmap(file + ".missing"));
+  ASSERT_TRUE(loaded.loadRoadmap(file));
+  std::remove(file.c_str());
+
+  EXPECT_EQ(g.nodeCount(), loaded.nodeCount());
+  EXPECT_TRUE(loaded.hierarchyCurrent());
+
+  loaded.setQueryMethod(QUERY_HIERARCHY);
+  std::vector<TGlobalOrd> reloaded = loaded.query(map, start, goal);
+  ASSERT_EQ(path.size(), reloaded.size());
+  for(unsigned int i = 0; i < path.size(); i++){
+    EXPECT_TRUE(path[i] == reloaded[i]);
+  }
+
+  //A file with an edge the hierarchy doesn't have is rejected, as queries would miss it
+  ASSERT_TRUE(g.saveRoadmap(file));
+  std::ifstream in(file);
+  std::stringstream saved;
+  saved << in.rdbuf();
+  in.close();
+
+  Graph network = g.networkGraph(version);
+  vertex far = 1;
+  while(network.getWeight(0, far) != std::numeric_limits<weight>::infinity()){
+    far++;
+  }
+
+  std::string contents = saved.str(), tag = "edges ";
+  size_t at = contents.find(tag);
+  size_t end = contents.find('\n', at);
+  unsigned long edges = std::stoul(contents.substr(at + tag.size(), end - at - tag.size()));
+  contents.replace(at, end - at + 1, tag + std::to_string(edges + 1) + "\n0 " + std::to_string(far) + " 0.001\n");
+  std::ofstream(file) << contents;
+
+  PrmPlanner corrupt;
+  corrupt.setReference(robot);
+  EXPECT_FALSE(corrupt.loadRoadmap(file));
+  EXPECT_EQ(0, corrupt.nodeCount());
+  std::remove(file.c_str());
+}
+
+TEST(PrmGen, HierarchyBridgingNodes){
+  cv::Mat map = partionedMap2();
+
+  TGlobalOrd robot{10, 10}, start{1, 1}, goal{10, 19};
+  PrmPlanner g;
+
+  g.setReference(robot);
+  g.expandConfigSpace(map, 0.2);
+
+  std::vector<TGlobalOrd> path;
+  int cnt(0);
+  while(path.size() <= 0 && cnt < MaxTries){
+    path = g.build(map, start, goal);
+    cnt++;
+  }
+  ASSERT_TRUE(path.size() > 0);
+
+  std::map<vertex, TGlobalOrd> nodes;
+  for(auto const &node: g.roadmapChanges().nodes){
+    nodes.insert(node);
+  }
+
+  //A node joined to several nodes of the hierarchy may shorten the paths between them
+  unsigned int bridges = 0;
+  for(int i = 0; i < 20; i++){
+    g.buildHierarchy();
+    if(g.densify(map, 1) == 0){
+      continue;
+    }
+
+    TRoadmap changes = g.roadmapChanges();
+    for(auto const &node: changes.nodes){
+      nodes.insert(node);
+    }
+
+    if(changes.edges.size() < 2){
+      continue;
+    }
+
+    bridges++;
+    EXPECT_FALSE(g.hierarchyCurrent());
+
+    //Edges are recorded from the new node, so compare paths between its neighbours
+    for(auto const &e1: changes.edges){
+      for(auto const &e2: changes.edges){
+        TGlobalOrd from = nodes[e1.second], to = nodes[e2.second];
+
+        g.setQueryMethod(QUERY_HIERARCHY);
+        std::vector<TGlobalOrd> fast = g.query(map, from, to);
+        g.setQueryMethod(QUERY_DIJKSTRA);
+        std::vector<TGlobalOrd> expected = g.query(map, from, to);
+
+        ASSERT_EQ(expected.size(), fast.size());
+        for(unsigned int j = 0; j < expected.size(); j++){
+          EXPECT_TRUE(expected[j] == fast[j]);
+        }
+      }
+    }
+  }
+
+  EXPECT_GT(bridges, 0u);
+}
+
 /* Graph tests */
 //The below tests are based on the graph examples found
 //on the website: https://brilliant.org/wiki/dijkstras-short-path-finder/
@@ -733,6 +1737,273 @@ TEST(Graph, RemoveEdge){
   EXPECT_EQ(0, c[0].size());
 }
 
+TEST(Graph, HasEdge){
+  Graph g(5);
+
+  g.addVertex(0);
+  g.addVertex(1);
+  g.addVertex(2);
+
+  g.addEdge(0, 1, 1.0);
+
+  EXPECT_TRUE(g.hasEdge(0, 1));
+  EXPECT_TRUE(g.hasEdge(1, 0));
+  EXPECT_FALSE(g.hasEdge(0, 2));
+  EXPECT_FALSE(g.hasEdge(0, 7));
+}
+
+TEST(Graph, RemoveVertexWithEdges){
+  Graph g(5);
+
+  g.addVertex(0);
+  g.addVertex(1);
+  g.addVertex(2);
+
+  g.addEdge(0, 1, 1.0);
+  g.addEdge(0, 2, 1.0);
+  g.addEdge(1, 2, 1.0);
+
+  ASSERT_TRUE(g.removeVertex(0));
+
+  //Back-edges held by the neighbours must also be removed
+  EXPECT_FALSE(g.hasEdge(1, 0));
+  EXPECT_FALSE(g.hasEdge(2, 0));
+  EXPECT_TRUE(g.hasEdge(1, 2));
+  EXPECT_EQ(1, g.getEdgeCount(1));
+  EXPECT_EQ(1, g.getEdgeCount(2));
+}
+
+TEST(Graph, ReuseWorkspace){
+  Graph g(5);
+  TSearchWorkspace workspace;
+
+  for(vertex v = 0; v < 4; v++){
+    g.addVertex(v);
+  }
+
+  g.addEdge(0, 1, 1.0);
+  g.addEdge(1, 2, 1.0);
+  g.addEdge(2, 3, 1.0);
+  g.addEdge(0, 3, 5.0);
+
+  std::vector<vertex> expected = {0, 1, 2, 3};
+  EXPECT_EQ(expected, g.shortestPath(0, 3, workspace));
+
+  //Distances left from the previous search must not leak into the next
+  g.removeVertex(1);
+  expected = {0, 3};
+  EXPECT_EQ(expected, g.shortestPath(0, 3, workspace));
+
+  g.removeVertex(0);
+  EXPECT_TRUE(g.shortestPath(2, 1, workspace).empty());
+
+  //The workspace grows with the graph
+  g.addVertex(10);
+  g.addEdge(3, 10, 1.0);
+  g.addEdge(2, 10, 1.0);
+  expected = {2, 10};
+  EXPECT_EQ(expected, g.shortestPath(2, 10, workspace));
+}
+
+TEST(Graph, IncrementalSearch){
+  Graph g(4);
+  TIncrementalSearch search;
+  const vertex side = 10;
+
+  //A grid, where each vertex is joined to its right and lower neighbour
+  for(vertex v = 0; v < side * side; v++){
+    g.addVertex(v);
+  }
+
+  for(vertex v = 0; v < side * side; v++){
+    if(v % side < side - 1){
+      g.addEdge(v, v + 1, 1.0);
+    }
+    if(v / side < side - 1){
+      g.addEdge(v, v + side, 1.0);
+    }
+  }
+
+  auto pathWeight = [&g](const std::vector<vertex> &path){
+    weight total = 0;
+    for(unsigned int i = 1; i < path.size(); i++){
+      total += g.getWeight(path[i - 1], path[i]);
+    }
+    return total;
+  };
+
+  vertex start = 0, goal = side * side - 1;
+  std::vector<vertex> path = g.shortestPath(start, goal, search);
+  ASSERT_EQ(2 * (side - 1) + 1, path.size());
+  unsigned long expansions = search.expansions;
+
+  //Cut the grid down the middle, except for the bottom row
+  for(vertex y = 0; y < side - 1; y++){
+    vertex v = y * side + side / 2 - 1;
+    ASSERT_TRUE(g.removeEdge(v, v + 1));
+    g.repairEdge(v, v + 1, search);
+  }
+
+  path = g.shortestPath(start, goal, search);
+  EXPECT_EQ(pathWeight(g.shortestPath(start, goal)), pathWeight(path));
+
+  //Reweighting the bottom row and moving the start only repairs the search
+  g.setWeight(side * (side - 1), side * (side - 1) + 1, 5.0);
+  g.repairEdge(side * (side - 1), side * (side - 1) + 1, search);
+  start = side + 1;
+
+  path = g.shortestPath(start, goal, search);
+  ASSERT_FALSE(path.empty());
+  EXPECT_EQ(start, path.front());
+  EXPECT_EQ(goal, path.back());
+  EXPECT_EQ(pathWeight(g.shortestPath(start, goal)), pathWeight(path));
+
+  //Closing the last gap leaves no path
+  g.removeEdge(side * (side - 1) + side / 2 - 1, side * (side - 1) + side / 2);
+  g.repairEdge(side * (side - 1) + side / 2 - 1, side * (side - 1) + side / 2, search);
+  EXPECT_TRUE(g.shortestPath(start, goal, search).empty());
+
+  //Reopening part of the cut finds the path again, without starting from scratch
+  expansions = search.expansions;
+  g.addEdge(side / 2 - 1, side / 2, 1.0);
+  g.repairEdge(side / 2 - 1, side / 2, search);
+  path = g.shortestPath(start, goal, search);
+  EXPECT_EQ(pathWeight(g.shortestPath(start, goal)), pathWeight(path));
+
+  TIncrementalSearch fresh;
+  path = g.shortestPath(start, goal, fresh);
+  EXPECT_EQ(pathWeight(g.shortestPath(start, goal)), pathWeight(path));
+  EXPECT_LT(search.expansions - expansions, fresh.expansions);
+}
+
+TEST(Graph, BlockedEdges){
+  Graph g(5);
+  TSearchWorkspace workspace;
+  TIncrementalSearch search;
+
+  for(vertex v = 0; v < 4; v++){
+    g.addVertex(v);
+  }
+
+  g.addEdge(0, 1, 1.0);
+  g.addEdge(1, 2, 1.0);
+  g.addEdge(2, 3, 1.0);
+  g.addEdge(0, 3, 5.0);
+
+  edgeSet blocked;
+  search.blocked = &blocked;
+
+  std::vector<vertex> expected = {0, 1, 2, 3};
+  EXPECT_EQ(expected, g.shortestPath(0, 3, workspace, &blocked));
+  EXPECT_EQ(expected, g.shortestPath(0, 3, search));
+
+  //Blocked edges are left out, but stay in the graph
+  blocked.insert(std::make_pair(1, 2));
+  g.repairEdge(1, 2, search);
+
+  expected = {0, 3};
+  EXPECT_EQ(expected, g.shortestPath(0, 3, workspace, &blocked));
+  EXPECT_EQ(expected, g.shortestPath(0, 3, search));
+  EXPECT_TRUE(g.hasEdge(1, 2));
+
+  blocked.clear();
+  g.repairEdge(1, 2, search);
+
+  expected = {0, 1, 2, 3};
+  EXPECT_EQ(expected, g.shortestPath(0, 3, search));
+}
+
+TEST(Graph, ContractionHierarchy){
+  const vertex side = 15;
+  Graph g(8);
+  std::default_random_engine generator(7);
+  std::uniform_real_distribution<double> weights(1.0, 2.0);
+
+  //A grid with some diagonals, so many paths are nearly as short as each other
+  for(vertex v = 0; v < side * side; v++){
+    g.addVertex(v);
+  }
+
+  for(vertex v = 0; v < side * side; v++){
+    if(v % side < side - 1){
+      g.addEdge(v, v + 1, weights(generator));
+    }
+    if(v / side < side - 1){
+      g.addEdge(v, v + side, weights(generator));
+    }
+    if(v % side < side - 1 && v / side < side - 1 && v % 3 == 0){
+      g.addEdge(v, v + side + 1, 1.5 * weights(generator));
+    }
+  }
+
+  ContractionHierarchy hierarchy;
+  hierarchy.build(g);
+
+  auto length = [&g](const std::vector<vertex> &path){
+    weight total = 0;
+    for(unsigned int i = 1; i < path.size(); i++){
+      total += g.getWeight(path[i - 1], path[i]);
+    }
+    return total;
+  };
+
+  TSearchWorkspace forward, backward, workspace;
+  std::uniform_int_distribution<vertex> pick(0, side * side - 1);
+  for(int i = 0; i < 100; i++){
+    vertex start = pick(generator), goal = pick(generator);
+    std::vector<vertex> expected = g.shortestPath(start, goal, workspace);
+    std::vector<vertex> path = hierarchy.shortestPath(start, goal, forward, backward);
+
+    //Every edge of the unpacked path is in the graph, and it is as short as Dijkstra's
+    ASSERT_EQ(expected.empty(), path.empty());
+    if(!path.empty()){
+      EXPECT_EQ(start, path.front());
+      EXPECT_EQ(goal, path.back());
+      EXPECT_NEAR(length(expected), length(path), 1e-9);
+    }
+  }
+
+  //A vertex joined afterwards is attached below the hierarchy
+  vertex extra = side * side;
+  g.addVertex(extra);
+  g.addEdge(extra, 0, 0.5);
+  EXPECT_TRUE(hierarchy.attach(extra, 0, 0.5));
+  EXPECT_FALSE(hierarchy.attach(1, 0, 1.0));
+  EXPECT_FALSE(hierarchy.attach(extra, 1, 1.0)); //Nothing could reach 1 through it
+  EXPECT_NEAR(length(g.shortestPath(extra, side * side - 1, workspace)),
+              length(hierarchy.shortestPath(extra, side * side - 1, forward, backward)), 1e-9);
+
+  //A saved hierarchy finds the same paths once loaded
+  std::stringstream stream;
+  hierarchy.save(stream);
+
+  ContractionHierarchy loaded;
+  ASSERT_TRUE(loaded.load(stream));
+  EXPECT_EQ(hierarchy.shortcuts(), loaded.shortcuts());
+  EXPECT_EQ(hierarchy.shortestPath(extra, 100, forward, backward), loaded.shortestPath(extra, 100, forward, backward));
+
+  std::stringstream garbage("not a hierarchy");
+  EXPECT_FALSE(loaded.load(garbage));
+  EXPECT_FALSE(loaded.empty());
+
+  //A shortcut must bypass a lower vertex with arcs up to both ends, or it can't be unpacked
+  std::stringstream broken("hierarchy 3 3 1 0\n0 0 1 2 1.0 1\n1 1 0\n2 2 0\n");
+  EXPECT_FALSE(loaded.load(broken));
+  EXPECT_TRUE(loaded.matches(g));
+
+  //A hierarchy only matches the graph it was built from
+  Graph other(8);
+  for(vertex v = 0; v <= extra; v++){
+    other.addVertex(v);
+  }
+  other.addEdge(0, 1, 100.0);
+  EXPECT_FALSE(loaded.matches(other));
+
+  //Nor a graph with an edge the hierarchy can't find a path as short as
+  g.addEdge(0, side * side - 1, 0.1);
+  EXPECT_FALSE(hierarchy.matches(g));
+}
+
 int main (int argc, char **argv){
   //Run with './devel/lib/prm_sim/prm_sim-test' in catkin_ws
   ::testing::InitGoogleTest(&argc, argv);